@@ -0,0 +1,4 @@
+(def {collatz} (\ {n steps} {if (== n 1) {steps} {if (== n (* 2 (/ n 2))) {collatz (/ n 2) (+ steps 1)} {collatz (+ (* 3 n) 1) (+ steps 1)}}}))
+(def {i steps} 1 0)
+(while {< i 100000} {= {i steps} (+ i 1) (+ steps (collatz i 0))})
+steps
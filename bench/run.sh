@@ -0,0 +1,11 @@
+#!/usr/bin/env bash
+# time each program in bench/ with the baseline compiler off, then on
+cd "$(dirname "$0")/.."
+TIMEFORMAT='%R s'
+
+for b in bench/*.lisp; do
+  for jit in 0 1; do
+    printf '%-8s jit %s  ' "$(basename "$b" .lisp)" "$jit"
+    time ( (echo "(jit $jit)"; cat "$b") | ./repl > /dev/null )
+  done
+done
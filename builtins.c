@@ -1,12 +1,28 @@
+#include <limits.h>
+#include <math.h>
+#include <stdlib.h>
 #include <string.h>
 
 #include "builtins.h"
+#include "lbig.h"
 #include "lenv.h"
+#include "lhamt.h"
+#include "ljit.h"
+#include "lmap.h"
+#include "lmemo.h"
+#include "lopt.h"
+#include "lprof.h"
+#include "lrope.h"
 #include "lval.h"
+#include "lvec.h"
 
 
 // FIXME
 lval* lval_eval(lenv*, lval*);
+lval* lval_exec(lenv*, lval*);
+lval* lval_exec_num(lenv*, lval*, long*);
+lval* lval_exec_sexpr(lenv*, lval*);
+lval* lval_exec_sexpr_num(lenv*, lval*, long*);
 lval* lval_pop(lval*, int);
 lval* lval_take(lval*, int);
 
@@ -17,6 +33,12 @@ lval* lval_take(lval*, int);
     lval_del(args); return err; \
   }
 
+/* special forms borrow their expression, so failing checks do not free it */
+#define LCHECK(cond, fmt, ...) \
+  if (!(cond)) { \
+    return lval_err(fmt, ##__VA_ARGS__); \
+  }
+
 #define LASSERT_NOT_EMPTY(func, args, index) \
   LASSERT(args, args->cell[index]->length != 0, \
     "Function '%s' passed {} for argument %i.", func, index);
@@ -31,17 +53,343 @@ lval* lval_take(lval*, int);
     "Function '%s' passed incorrect type for argument %i. Got %s, expected %s.", \
     func, index, ltype_name(args->cell[index]->type), ltype_name(expect))
 
+#define LASSERT_NUMBERS(func, args, index) \
+  LASSERT(args, lvec_numeric(args->cell[index]->vec), \
+    "Function '%s' passed a vector that is not all numbers for argument %i.", \
+    func, index)
+
+/* index argument in range for a vector, one past the end when end is set */
+#define LASSERT_INDEX(func, args, index, length, end) \
+  LASSERT(args, args->cell[index]->num >= 0 && \
+    args->cell[index]->num < length + end, \
+    "Function '%s' passed index %li for a vector of length %li.", \
+    func, args->cell[index]->num, length)
+
+#define LASSERT_VECTOR(func, args, index) \
+  LASSERT(args, args->cell[index]->type == LVAL_VEC || \
+    args->cell[index]->type == LVAL_PVEC, \
+    "Function '%s' passed incorrect type for argument %i. Got %s, expected %s.", \
+    func, index, ltype_name(args->cell[index]->type), ltype_name(LVAL_VEC))
+
+
+/* value of any number as a double */
+static double lop_double(lval* lv) {
+  switch (lv->type) {
+    case LVAL_BIG:
+      return lbig_double(lv->big);
+
+    case LVAL_FLOAT:
+      return lv->flt;
+  }
+
+  return lv->num;
+}
+
+/* number of elements of a vector or persistent vector */
+static long lvec_length(lval* lv) {
+  return lv->type == LVAL_PVEC ? lrope_length(lv->rope) : lv->vec->length;
+}
+
+/* persistent vector of the elements from up to but not including to of
+ * the one in argument 0 */
+static lval* lrope_range(lval* lv, long from, long to) {
+  lrope* rope = lrope_slice(lv->cell[0]->rope, from, to);
+  lval_del(lv);
+  return lval_pvec(rope);
+}
+
+/* copy the values of the local symbols an expression uses into env, as
+ * the frames they live in may be gone by the time a thunk is forced */
+static void lval_capture(lenv* le, lenv* env, lval* lv) {
+
+  if (lv->type == LVAL_SEXPR || lv->type == LVAL_QEXPR) {
+    for (int i = 0; i < lv->length; i++) {
+      lval_capture(le, env, lv->cell[i]);
+    }
+  }
+
+  if (lv->type != LVAL_SYM) {
+    return;
+  }
+
+  for (int i = 0; i < env->length; i++) {
+    if (strcmp(env->symbols[i], lv->sym) == 0) {
+      return;
+    }
+  }
+
+  /* the global environment outlives any thunk and is not captured */
+  for (; le->parent; le = le->parent) {
+    for (int i = 0; i < le->length; i++) {
+      if (strcmp(le->symbols[i], lv->sym) == 0) {
+        lenv_put(env, lv, le->lvals[i]);
+        return;
+      }
+    }
+  }
+}
+
+/* delay an expression given as a Q-Expression */
+static lval* lval_delay(lenv* le, lval* expr) {
+  lenv* env = lenv_new();
+  lval_capture(le, env, expr);
+  return lval_thunk(env, expr);
+}
+
+/* evaluate the elements of a list the way arguments are, returns the list
+ * or the first error */
+static lval* lval_eval_cells(lenv* le, lval* lv) {
+  for (int i = 0; i < lv->length; i++) {
+    lv->cell[i] = lval_eval(le, lv->cell[i]);
+
+    if (lv->cell[i]->type == LVAL_ERR) {
+      return lval_take(lv, i);
+    }
+  }
+
+  return lv;
+}
+
+/* evaluate a branch of a special form, Q-Expressions are evaluated as bodies */
+static lval* lval_exec_branch(lenv* le, lval* lv) {
+  if (lv->type == LVAL_QEXPR) {
+    return lval_exec_sexpr(le, lv);
+  }
+
+  return lval_exec(le, lv);
+}
+
+/* test a condition, fused with the comparison it usually is so the
+ * truth value is never boxed. Returns NULL or the error */
+static lval* lval_exec_cond(lenv* le, lval* lv, char* func, long* truth) {
+  lval* cond = lv->type == LVAL_QEXPR
+    ? lval_exec_sexpr_num(le, lv, truth)
+    : lval_exec_num(le, lv, truth);
+
+  /* big integers are never zero */
+  if (cond && cond->type == LVAL_BIG) {
+    lval_del(cond);
+    *truth = 1;
+    return NULL;
+  }
+
+  if (cond && cond->type == LVAL_FLOAT) {
+    *truth = cond->flt != 0;
+    lval_del(cond);
+    return NULL;
+  }
+
+  if (cond && cond->type != LVAL_ERR) {
+    lval* err = lval_err(
+      "Function '%s' passed incorrect type for condition. "
+      "Got %s, expected %s.",
+      func, ltype_name(cond->type), ltype_name(LVAL_NUM));
+
+    lval_del(cond);
+    return err;
+  }
+
+  return cond;
+}
+
 
 lval* builtin_add(lenv* le, lval* lv) {
-  return builtin_op(le, lv, "+");
+  return builtin_op(le, lv, LOP_ADD);
+}
+
+/* special form, clauses are {condition body...} and the first true one runs */
+lval* builtin_cond(lenv* le, lval* lv) {
+  for (int i = 1; i < lv->length; i++) {
+    LCHECK(lv->cell[i]->type == LVAL_QEXPR,
+      "Function 'cond' passed incorrect type for argument %i. "
+      "Got %s, expected %s.",
+      i - 1, ltype_name(lv->cell[i]->type), ltype_name(LVAL_QEXPR));
+    LCHECK(lv->cell[i]->length != 0,
+      "Function 'cond' passed {} for argument %i.", i - 1);
+  }
+
+  for (int i = 1; i < lv->length; i++) {
+    lval* clause = lv->cell[i];
+    long truth;
+    lval* err = lval_exec_cond(le, clause->cell[0], "cond", &truth);
+
+    if (err) {
+      return err;
+    }
+
+    if (!truth) {
+      continue;
+    }
+
+    /* evaluate the rest of the clause through a view, without copying it */
+    lval rest = *clause;
+    rest.length = clause->length - 1;
+    rest.cell = clause->cell + 1;
+
+    return lval_exec_sexpr(le, &rest);
+  }
+
+  return lval_sexpr();
 }
 
 lval* builtin_def(lenv* le, lval* la) {
   return builtin_var(le, la, "def");
 }
 
+/* (delay {expr}) returns a thunk evaluating expr when it is first forced */
+lval* builtin_delay(lenv* le, lval* lv) {
+  LASSERT_NUM("delay", lv, 1);
+  LASSERT_TYPE("delay", lv, 0, LVAL_QEXPR);
+
+  return lval_delay(le, lval_take(lv, 0));
+}
+
 lval* builtin_div(lenv* le, lval* lv) {
-  return builtin_op(le, lv, "/");
+  return builtin_op(le, lv, LOP_DIV);
+}
+
+lval* builtin_eq(lenv* le, lval* lv) {
+  return builtin_op(le, lv, LOP_EQ);
+}
+
+lval* builtin_force(lenv* le, lval* lv) {
+  LASSERT_NUM("force", lv, 1);
+
+  return lval_force(le, lval_take(lv, 0));
+}
+
+/* the most frequent node pairs counted since profiling was switched on */
+lval* builtin_fusion_table(lenv* le, lval* lv) {
+  LASSERT_NUM("fusion-table", lv, 1);
+  LASSERT_TYPE("fusion-table", lv, 0, LVAL_NUM);
+
+  int limit = lv->cell[0]->num;
+  lval_del(lv);
+  return lprof_table(limit);
+}
+
+lval* builtin_ge(lenv* le, lval* lv) {
+  return builtin_op(le, lv, LOP_GE);
+}
+
+lval* builtin_gt(lenv* le, lval* lv) {
+  return builtin_op(le, lv, LOP_GT);
+}
+
+/* (hdel m key) removes key from a map in place and returns the map */
+lval* builtin_hdel(lenv* le, lval* lv) {
+  LASSERT_NUM("hdel", lv, 2);
+  LASSERT_TYPE("hdel", lv, 0, LVAL_MAP);
+
+  lmap_remove(lv->cell[0]->map, lv->cell[1]);
+  return lval_take(lv, 0);
+}
+
+/* (hget m key) is the value stored under key, and (hget m key default)
+ * gives default when there is none */
+lval* builtin_hget(lenv* le, lval* lv) {
+  LASSERT(lv, lv->length == 2 || lv->length == 3,
+    "Function 'hget' passed incorrect number of arguments. "
+    "Got %i, expected 2 or 3.", lv->length);
+  LASSERT_TYPE("hget", lv, 0, LVAL_MAP);
+
+  lval* value = lmap_get(lv->cell[0]->map, lv->cell[1]);
+
+  if (value) {
+    value = lval_copy(value);
+    lval_del(lv);
+    return value;
+  }
+
+  LASSERT(lv, lv->length == 3,
+    "Function 'hget' passed a key that is not in the map.");
+
+  return lval_take(lv, 2);
+}
+
+lval* builtin_hkeys(lenv* le, lval* lv) {
+  LASSERT_NUM("hkeys", lv, 1);
+  LASSERT_TYPE("hkeys", lv, 0, LVAL_MAP);
+
+  lval* keys = lmap_keys(lv->cell[0]->map);
+  lval_del(lv);
+  return keys;
+}
+
+/* (hmap {key value ...}) builds a map from the elements of a Q-Expression.
+ * They are evaluated like the values of let, so symbols stand for what
+ * they are bound to just as in the keys hget and hdel are given */
+lval* builtin_hmap(lenv* le, lval* lv) {
+  LASSERT_NUM("hmap", lv, 1);
+  LASSERT_TYPE("hmap", lv, 0, LVAL_QEXPR);
+  LASSERT(lv, lv->cell[0]->length % 2 == 0,
+    "Function 'hmap' passed an odd number of elements. Got %i.",
+    lv->cell[0]->length);
+
+  lval* pairs = lval_eval_cells(le, lval_take(lv, 0));
+
+  if (pairs->type == LVAL_ERR) {
+    return pairs;
+  }
+
+  lmap* map = lmap_new();
+
+  for (int i = 0; i < pairs->length; i += 2) {
+    lmap_set(map, pairs->cell[i], pairs->cell[i + 1]);
+  }
+
+  /* the elements were moved into the map */
+  pairs->length = 0;
+  lval_del(pairs);
+
+  return lval_map(map);
+}
+
+/* (hset m key value) stores value under key in place and returns the map */
+lval* builtin_hset(lenv* le, lval* lv) {
+  LASSERT_NUM("hset", lv, 3);
+  LASSERT_TYPE("hset", lv, 0, LVAL_MAP);
+  LASSERT(lv, !lval_contains(lv->cell[1], lv->cell[0]) &&
+              !lval_contains(lv->cell[2], lv->cell[0]),
+    "Function 'hset' cannot put a map inside itself.");
+
+  lval* value = lval_pop(lv, 2);
+  lval* key = lval_pop(lv, 1);
+
+  lmap_set(lv->cell[0]->map, key, value);
+  return lval_take(lv, 0);
+}
+
+lval* builtin_hsize(lenv* le, lval* lv) {
+  LASSERT_NUM("hsize", lv, 1);
+  LASSERT_TYPE("hsize", lv, 0, LVAL_MAP);
+
+  long length = lv->cell[0]->map->length;
+  lval_del(lv);
+  return lval_num(length);
+}
+
+/* special form, (if condition then else) with the else branch optional */
+lval* builtin_if(lenv* le, lval* lv) {
+  LCHECK(lv->length == 3 || lv->length == 4,
+    "Function 'if' passed incorrect number of arguments. "
+    "Got %i, expected 2 or 3.", lv->length - 1);
+
+  long truth;
+  lval* err = lval_exec_cond(le, lv->cell[1], "if", &truth);
+
+  if (err) {
+    return err;
+  }
+
+  int branch = truth ? 2 : 3;
+
+  if (branch >= lv->length) {
+    return lval_sexpr();
+  }
+
+  /* only the branch taken is evaluated, in place */
+  return lval_exec_branch(le, lv->cell[branch]);
 }
 
 lval* builtin_lambda(lenv* le, lval* la) {
@@ -62,6 +410,7 @@ lval* builtin_lambda(lenv* le, lval* la) {
   lval* body = lval_pop(la, 0);
   lval_del(la);
 
+  /* the body is optimized later, once calls to it get hot */
   return lval_lambda(args, body);
 }
 
@@ -76,19 +425,55 @@ lval* builtin_eval(lenv* le, lval* lv) {
 
 lval* builtin_head(lenv* le, lval* lv) {
   LASSERT_NUM("head", lv, 1);
+
+  if (lv->cell[0]->type == LVAL_PVEC) {
+    LASSERT(lv, lv->cell[0]->rope,
+      "Function 'head' passed #[] for argument 0.");
+
+    return lrope_range(lv, 0, 1);
+  }
+
   LASSERT_TYPE("head", lv, 0, LVAL_QEXPR);
   LASSERT_NOT_EMPTY("head", lv, 0);
 
   lval* head = lval_take(lv, 0);
 
-  while (head->length > 1) {
-    lval_del(lval_pop(head, 1));
+  /* drop the rest in one pass instead of shifting it down each time */
+  for (int i = 1; i < head->length; i++) {
+    lval_del(head->cell[i]);
   }
 
+  head->length = 1;
   return head;
 }
 
+lval* builtin_jit(lenv* le, lval* lv) {
+  LASSERT_NUM("jit", lv, 1);
+  LASSERT_TYPE("jit", lv, 0, LVAL_NUM);
+
+  ljit_on = lv->cell[0]->num != 0;
+  lval_del(lv);
+  return lval_sexpr();
+}
+
 lval* builtin_join(lenv* le, lval* lv) {
+  /* persistent vectors are joined by sharing both trees */
+  if (lv->cell[0]->type == LVAL_PVEC) {
+    for (int i = 0; i < lv->length; i++) {
+      LASSERT_TYPE("join", lv, i, LVAL_PVEC);
+    }
+
+    lrope* acc = NULL;
+
+    for (int i = 0; i < lv->length; i++) {
+      acc = lrope_join(acc, lv->cell[i]->rope);
+      lv->cell[i]->rope = NULL;
+    }
+
+    lval_del(lv);
+    return lval_pvec(acc);
+  }
+
   for (int i = 0; i < lv->length; i++) {
     LASSERT_TYPE("join", lv, i, LVAL_QEXPR);
   }
@@ -103,68 +488,506 @@ lval* builtin_join(lenv* le, lval* lv) {
   return acc;
 }
 
+/* (lcons x {tail}) builds the lazy sequence {x <thunk>} */
+lval* builtin_lcons(lenv* le, lval* lv) {
+  LASSERT_NUM("lcons", lv, 2);
+  LASSERT_TYPE("lcons", lv, 1, LVAL_QEXPR);
+
+  lval* head = lval_pop(lv, 0);
+  lval* tail = lval_delay(le, lval_take(lv, 0));
+
+  return lval_add(lval_add(lval_qexpr(), head), tail);
+}
+
+lval* builtin_le(lenv* le, lval* lv) {
+  return builtin_op(le, lv, LOP_LE);
+}
+
+/* (len v) is the number of elements of a vector */
+lval* builtin_len(lenv* le, lval* lv) {
+  LASSERT_NUM("len", lv, 1);
+  LASSERT_VECTOR("len", lv, 0);
+
+  long length = lvec_length(lv->cell[0]);
+  lval_del(lv);
+  return lval_num(length);
+}
+
+/* special form, (let {symbol value ...} body) binds values in a new scope */
+lval* builtin_let(lenv* le, lval* lv) {
+  LCHECK(lv->length == 3,
+    "Function 'let' passed incorrect number of arguments. "
+    "Got %i, expected %i.", lv->length - 1, 2);
+  LCHECK(lv->cell[1]->type == LVAL_QEXPR,
+    "Function 'let' passed incorrect type for argument 0. "
+    "Got %s, expected %s.",
+    ltype_name(lv->cell[1]->type), ltype_name(LVAL_QEXPR));
+
+  lval* bindings = lv->cell[1];
+
+  LCHECK(bindings->length % 2 == 0,
+    "Function 'let' passed an odd number of binding elements. Got %i.",
+    bindings->length);
+
+  for (int i = 0; i < bindings->length; i += 2) {
+    LCHECK(bindings->cell[i]->type == LVAL_SYM,
+      "Function 'let' cannot define non-symbol. "
+      "Got %s, Expected %s.",
+      ltype_name(bindings->cell[i]->type), ltype_name(LVAL_SYM));
+  }
+
+  lenv* scope = lenv_new();
+  scope->parent = le;
+
+  /* values are evaluated in order and can see the ones before them */
+  for (int i = 0; i < bindings->length; i += 2) {
+    lval* value = lval_exec(scope, bindings->cell[i + 1]);
+
+    if (value->type == LVAL_ERR) {
+      lenv_del(scope);
+      return value;
+    }
+
+    lenv_put(scope, bindings->cell[i], value);
+    lval_del(value);
+  }
+
+  lval* acc = lval_exec_branch(scope, lv->cell[2]);
+  lenv_del(scope);
+  return acc;
+}
+
+/* (lrange a) and (lrange a b) count lazily from a, up to b excluded */
+lval* builtin_lrange(lenv* le, lval* lv) {
+  LASSERT(lv, lv->length == 1 || lv->length == 2,
+    "Function 'lrange' passed incorrect number of arguments. "
+    "Got %i, expected 1 or 2.", lv->length);
+
+  for (int i = 0; i < lv->length; i++) {
+    LASSERT_TYPE("lrange", lv, i, LVAL_NUM);
+  }
+
+  long from = lv->cell[0]->num;
+
+  if (lv->length == 2 && from >= lv->cell[1]->num) {
+    lval_del(lv);
+    return lval_qexpr();
+  }
+
+  /* the rest of the range is the same call starting one further */
+  lval* rest = lval_add(lval_qexpr(), lval_sym("lrange"));
+  rest = lval_add(rest, lval_num(from + 1));
+
+  if (lv->length == 2) {
+    rest = lval_add(rest, lval_num(lv->cell[1]->num));
+  }
+
+  lval_del(lv);
+
+  lval* acc = lval_add(lval_qexpr(), lval_num(from));
+  return lval_add(acc, lval_thunk(lenv_new(), rest));
+}
+
+/* (ltail s) forces the rest of a lazy sequence */
+lval* builtin_ltail(lenv* le, lval* lv) {
+  LASSERT_NUM("ltail", lv, 1);
+  LASSERT_TYPE("ltail", lv, 0, LVAL_QEXPR);
+  LASSERT(lv, lv->cell[0]->length == 2,
+    "Function 'ltail' passed a list that is not a lazy sequence. "
+    "Got %i elements, expected 2.", lv->cell[0]->length);
+
+  lval* seq = lval_take(lv, 0);
+  return lval_force(le, lval_take(seq, 1));
+}
+
+/* (ltake n s) forces the first n elements of a lazy sequence into a list */
+lval* builtin_ltake(lenv* le, lval* lv) {
+  LASSERT_NUM("ltake", lv, 2);
+  LASSERT_TYPE("ltake", lv, 0, LVAL_NUM);
+  LASSERT_TYPE("ltake", lv, 1, LVAL_QEXPR);
+
+  long n = lv->cell[0]->num;
+  lval* seq = lval_take(lv, 1);
+  lval* acc = lval_qexpr();
+
+  while (n > 0 && seq->length == 2) {
+    acc = lval_add(acc, lval_pop(seq, 0));
+
+    /* the rest after the last element taken is left unforced */
+    if (--n == 0) {
+      break;
+    }
+
+    seq = lval_force(le, lval_take(seq, 0));
+
+    if (seq->type == LVAL_ERR) {
+      lval_del(acc);
+      return seq;
+    }
+
+    if (seq->type != LVAL_QEXPR) {
+      lval* err = lval_err(
+        "Function 'ltake' found %s where a lazy sequence was expected.",
+        ltype_name(seq->type));
+
+      lval_del(seq);
+      lval_del(acc);
+      return err;
+    }
+  }
+
+  lval_del(seq);
+  return acc;
+}
+
 lval* builtin_list(lenv* le, lval* lv) {
   lv->type = LVAL_QEXPR;
   return lv;
 }
 
+lval* builtin_lt(lenv* le, lval* lv) {
+  return builtin_op(le, lv, LOP_LT);
+}
+
+/* wrap a function with a cache of its results, (memo f) or (memo f size) */
+lval* builtin_memo(lenv* le, lval* lv) {
+  LASSERT(lv, lv->length == 1 || lv->length == 2,
+    "Function 'memo' passed incorrect number of arguments. "
+    "Got %i, expected 1 or 2.", lv->length);
+  LASSERT_TYPE("memo", lv, 0, LVAL_FUNC);
+
+  int capacity = 1024;
+
+  if (lv->length == 2) {
+    LASSERT_TYPE("memo", lv, 1, LVAL_NUM);
+    LASSERT(lv, lv->cell[1]->num >= 0 && lv->cell[1]->num <= 1 << 24,
+      "Function 'memo' passed invalid capacity %li.", lv->cell[1]->num);
+
+    capacity = lv->cell[1]->num;
+  }
+
+  return lval_memo(lval_take(lv, 0), capacity);
+}
+
+/* hits, misses, evictions and size of a memoized function's cache */
+lval* builtin_memo_stats(lenv* le, lval* lv) {
+  LASSERT_NUM("memo-stats", lv, 1);
+  LASSERT_TYPE("memo-stats", lv, 0, LVAL_FUNC);
+  LASSERT(lv, lv->cell[0]->memo != NULL,
+    "Function 'memo-stats' passed a function that is not memoized.");
+
+  lval* stats = lmemo_stats(lv->cell[0]->memo);
+  lval_del(lv);
+  return stats;
+}
+
 lval* builtin_mul(lenv* le, lval* lv) {
-  return builtin_op(le, lv, "*");
+  return builtin_op(le, lv, LOP_MUL);
+}
+
+lval* builtin_ne(lenv* le, lval* lv) {
+  return builtin_op(le, lv, LOP_NE);
+}
+
+/* (nth v i) is element i of a vector, counting from zero */
+lval* builtin_nth(lenv* le, lval* lv) {
+  LASSERT_NUM("nth", lv, 2);
+  LASSERT_VECTOR("nth", lv, 0);
+  LASSERT_TYPE("nth", lv, 1, LVAL_NUM);
+  LASSERT_INDEX("nth", lv, 1, lvec_length(lv->cell[0]), 0);
+
+  lval* vec = lv->cell[0];
+  lval* result = vec->type == LVAL_PVEC ?
+    lval_copy(lrope_get(vec->rope, lv->cell[1]->num)) :
+    lvec_get(vec->vec, lv->cell[1]->num);
+
+  lval_del(lv);
+  return result;
 }
 
-lval* builtin_op(lenv* le, lval* lv, char* op) {
+lval* builtin_op(lenv* le, lval* lv, int op) {
+  char* name = lop_name(op);
+
+  /* ensure there is at least one argument and all of them are numbers */
+  LASSERT(lv, lv->length > 0,
+    "Function '%s' passed no arguments.", name);
+
+  int big = 0;
+  int flt = 0;
 
-  /* ensure all arguments are numbers */
   for (int i = 0; i < lv->length; i++) {
-    LASSERT_TYPE(op, lv, i, LVAL_NUM);
+    int type = lv->cell[i]->type;
+
+    LASSERT(lv, type == LVAL_NUM || type == LVAL_BIG || type == LVAL_FLOAT,
+      "Function '%s' passed incorrect type for argument %i. Got %s, expected %s.",
+      name, i, ltype_name(type), ltype_name(LVAL_NUM));
+
+    big = big || type == LVAL_BIG;
+    flt = flt || type == LVAL_FLOAT;
   }
 
-  /* pop the first element */
-  lval* acc = lval_pop(lv, 0);
+  /* a single float makes the whole operation floating point */
+  if (flt) {
+    double scratch[LOP_SCRATCH];
+    double* x = lv->length > LOP_SCRATCH
+      ? malloc(sizeof(double) * lv->length) : scratch;
+
+    for (int i = 0; i < lv->length; i++) {
+      x[i] = lop_double(lv->cell[i]);
+    }
+
+    double acc;
+    int ok = lop_fold_float(op, x, lv->length, &acc);
+
+    if (x != scratch) {
+      free(x);
+    }
+
+    LASSERT(lv, ok != 0, "Division by zero!");
+    LASSERT(lv, ok != -1, "Float overflow!");
+    lval_del(lv);
 
-  /* if no arguments and sub then perform unary negation */
-  if ((strcmp(op, "-") == 0) && lv->length == 0) {
-    acc->num = -acc->num;
+    /* comparisons yield a truth value, like they do for integers */
+    switch (op) {
+      case LOP_ADD:
+      case LOP_DIV:
+      case LOP_MUL:
+      case LOP_SUB:
+        return lval_float(acc);
+    }
+
+    return lval_num(acc != 0);
   }
 
-  /* while there are still elements remaining */
-  while (lv->length > 0) {
+  long acc;
+  int ok = -1;
 
-    /* pop the next element */
-    lval* current = lval_pop(lv, 0);
+  /* gather the numbers into a scratch vector, on the stack when small */
+  if (!big) {
+    long scratch[LOP_SCRATCH];
+    long* x = lv->length > LOP_SCRATCH
+      ? malloc(sizeof(long) * lv->length) : scratch;
 
-    if (strcmp(op, "+") == 0) { acc->num += current->num; }
-    if (strcmp(op, "-") == 0) { acc->num -= current->num; }
-    if (strcmp(op, "*") == 0) { acc->num *= current->num; }
-    if (strcmp(op, "/") == 0) {
+    for (int i = 0; i < lv->length; i++) {
+      x[i] = lv->cell[i]->num;
+    }
 
-      if (current->num == 0) {
-        lval_del(acc);
-        lval_del(current);
-        acc = lval_err("Division by zero!");
-        break;
-      }
+    ok = lop_fold(op, x, lv->length, &acc);
 
-      acc->num /= current->num;
+    if (x != scratch) {
+      free(x);
     }
+  }
+
+  LASSERT(lv, ok, "Division by zero!");
+
+  /* fold again with big integers when any number does not fit a long */
+  lval* result = ok < 0
+    ? lbig_op(op, lv->cell, lv->length) : lval_num(acc);
+
+  lval_del(lv);
+  return result;
+}
+
+/* (pdel m key) is a new version of a persistent map without key */
+lval* builtin_pdel(lenv* le, lval* lv) {
+  LASSERT_NUM("pdel", lv, 2);
+  LASSERT_TYPE("pdel", lv, 0, LVAL_PMAP);
+
+  lhamt* next = lhamt_remove(lv->cell[0]->hamt, lv->cell[1]);
+  lval_del(lv);
+  return lval_pmap(next);
+}
 
-    lval_del(current);
+/* (pget m key) is the value stored under key, and (pget m key default)
+ * gives default when there is none */
+lval* builtin_pget(lenv* le, lval* lv) {
+  LASSERT(lv, lv->length == 2 || lv->length == 3,
+    "Function 'pget' passed incorrect number of arguments. "
+    "Got %i, expected 2 or 3.", lv->length);
+  LASSERT_TYPE("pget", lv, 0, LVAL_PMAP);
+
+  lval* value = lhamt_get(lv->cell[0]->hamt, lv->cell[1]);
+
+  if (value) {
+    value = lval_copy(value);
+    lval_del(lv);
+    return value;
   }
 
+  LASSERT(lv, lv->length == 3,
+    "Function 'pget' passed a key that is not in the map.");
+
+  return lval_take(lv, 2);
+}
+
+lval* builtin_pkeys(lenv* le, lval* lv) {
+  LASSERT_NUM("pkeys", lv, 1);
+  LASSERT_TYPE("pkeys", lv, 0, LVAL_PMAP);
+
+  lval* keys = lhamt_keys(lv->cell[0]->hamt);
   lval_del(lv);
-  return acc;
+  return keys;
+}
+
+/* (pmap {key value ...}) builds a persistent map like hmap does */
+lval* builtin_pmap(lenv* le, lval* lv) {
+  LASSERT_NUM("pmap", lv, 1);
+  LASSERT_TYPE("pmap", lv, 0, LVAL_QEXPR);
+  LASSERT(lv, lv->cell[0]->length % 2 == 0,
+    "Function 'pmap' passed an odd number of elements. Got %i.",
+    lv->cell[0]->length);
+
+  lval* pairs = lval_eval_cells(le, lval_take(lv, 0));
+
+  if (pairs->type == LVAL_ERR) {
+    return pairs;
+  }
+
+  lhamt* map = lhamt_new();
+
+  for (int i = 0; i < pairs->length; i += 2) {
+    lhamt* next = lhamt_set(map, pairs->cell[i], pairs->cell[i + 1]);
+    lhamt_del(map);
+    map = next;
+  }
+
+  /* the elements were moved into the map */
+  pairs->length = 0;
+  lval_del(pairs);
+
+  return lval_pmap(map);
+}
+
+/* switch counting of node pairs on, starting from zero, or off */
+lval* builtin_profile(lenv* le, lval* lv) {
+  LASSERT_NUM("profile", lv, 1);
+  LASSERT_TYPE("profile", lv, 0, LVAL_NUM);
+
+  if (lv->cell[0]->num && !lprof_on) {
+    lprof_reset();
+  }
+
+  lprof_on = lv->cell[0]->num != 0;
+  lval_del(lv);
+  return lval_sexpr();
+}
+
+/* (pset m key value) is a new version of a persistent map with value
+ * stored under key, sharing all but one path of the trie with m */
+lval* builtin_pset(lenv* le, lval* lv) {
+  LASSERT_NUM("pset", lv, 3);
+  LASSERT_TYPE("pset", lv, 0, LVAL_PMAP);
+
+  lval* value = lval_pop(lv, 2);
+  lval* key = lval_pop(lv, 1);
+
+  lhamt* next = lhamt_set(lv->cell[0]->hamt, key, value);
+  lval_del(lv);
+  return lval_pmap(next);
+}
+
+lval* builtin_psize(lenv* le, lval* lv) {
+  LASSERT_NUM("psize", lv, 1);
+  LASSERT_TYPE("psize", lv, 0, LVAL_PMAP);
+
+  long length = lv->cell[0]->hamt->length;
+  lval_del(lv);
+  return lval_num(length);
+}
+
+/* (push v x) appends x to a vector in place and returns the vector */
+lval* builtin_push(lenv* le, lval* lv) {
+  LASSERT_NUM("push", lv, 2);
+  LASSERT_TYPE("push", lv, 0, LVAL_VEC);
+
+  lvec* vec = lv->cell[0]->vec;
+  LASSERT(lv, !lval_contains(lv->cell[1], lv->cell[0]),
+    "Function 'push' cannot put a vector inside itself.");
+
+  lvec_push(vec, lval_pop(lv, 1));
+  return lval_take(lv, 0);
 }
 
 lval* builtin_put(lenv* le, lval* la) {
   return builtin_var(le, la, "=");
 }
 
+/* (pvec {a b c}) builds a persistent vector from the elements of a
+ * Q-Expression, evaluated like the ones hmap and pmap are given */
+lval* builtin_pvec(lenv* le, lval* lv) {
+  LASSERT_NUM("pvec", lv, 1);
+  LASSERT_TYPE("pvec", lv, 0, LVAL_QEXPR);
+
+  lval* cells = lval_eval_cells(le, lval_take(lv, 0));
+
+  if (cells->type == LVAL_ERR) {
+    return cells;
+  }
+
+  lrope* rope = lrope_new(cells->cell, cells->length);
+
+  /* the elements were moved into the vector */
+  cells->length = 0;
+  lval_del(cells);
+
+  return lval_pvec(rope);
+}
+
+/* (set v i x) replaces element i of a vector in place and returns the
+ * vector */
+lval* builtin_set(lenv* le, lval* lv) {
+  LASSERT_NUM("set", lv, 3);
+  LASSERT_TYPE("set", lv, 0, LVAL_VEC);
+  LASSERT_TYPE("set", lv, 1, LVAL_NUM);
+
+  lvec* vec = lv->cell[0]->vec;
+  LASSERT_INDEX("set", lv, 1, vec->length, 0);
+  LASSERT(lv, !lval_contains(lv->cell[2], lv->cell[0]),
+    "Function 'set' cannot put a vector inside itself.");
+
+  lvec_set(vec, lv->cell[1]->num, lval_pop(lv, 2));
+  return lval_take(lv, 0);
+}
+
+/* (slice v from to) is a new vector of the elements from up to but not
+ * including to, copied out of a vector and shared with a persistent one */
+lval* builtin_slice(lenv* le, lval* lv) {
+  LASSERT_NUM("slice", lv, 3);
+  LASSERT_VECTOR("slice", lv, 0);
+  LASSERT_TYPE("slice", lv, 1, LVAL_NUM);
+  LASSERT_TYPE("slice", lv, 2, LVAL_NUM);
+  LASSERT_INDEX("slice", lv, 1, lvec_length(lv->cell[0]), 1);
+  LASSERT_INDEX("slice", lv, 2, lvec_length(lv->cell[0]), 1);
+  LASSERT(lv, lv->cell[1]->num <= lv->cell[2]->num,
+    "Function 'slice' passed a range from %li down to %li.",
+    lv->cell[1]->num, lv->cell[2]->num);
+
+  if (lv->cell[0]->type == LVAL_PVEC) {
+    return lrope_range(lv, lv->cell[1]->num, lv->cell[2]->num);
+  }
+
+  lvec* slice = lvec_slice(lv->cell[0]->vec, lv->cell[1]->num,
+    lv->cell[2]->num);
+
+  lval_del(lv);
+  return lval_vec(slice);
+}
+
 lval* builtin_sub(lenv* le, lval* lv) {
-  return builtin_op(le, lv, "-");
+  return builtin_op(le, lv, LOP_SUB);
 }
 
 lval* builtin_tail(lenv* le, lval* lv) {
   LASSERT_NUM("tail", lv, 1);
+
+  if (lv->cell[0]->type == LVAL_PVEC) {
+    LASSERT(lv, lv->cell[0]->rope,
+      "Function 'tail' passed #[] for argument 0.");
+
+    return lrope_range(lv, 1, lrope_length(lv->cell[0]->rope));
+  }
+
   LASSERT_TYPE("tail", lv, 0, LVAL_QEXPR);
   LASSERT_NOT_EMPTY("tail", lv, 0);
 
@@ -173,6 +996,204 @@ lval* builtin_tail(lenv* le, lval* lv) {
   return acc;
 }
 
+/* tier, calls, loop iterations, promotions and deoptimizations of a
+ * lambda, tier 0 is the tree-walker and 1 the optimized body */
+lval* builtin_tier_stats(lenv* le, lval* lv) {
+  LASSERT_NUM("tier-stats", lv, 1);
+  LASSERT_TYPE("tier-stats", lv, 0, LVAL_FUNC);
+  LASSERT(lv, !lv->cell[0]->builtin && !lv->cell[0]->memo,
+    "Function 'tier-stats' passed a builtin or memoized function.");
+
+  /* partial applications report on the lambda they apply */
+  lval* func = lv->cell[0];
+  lval* stats = lopt_tier_stats(
+    func->partial ? func->partial->func->code : func->code);
+  lval_del(lv);
+  return stats;
+}
+
+/* (vdot x y) is the dot product of two vectors of the same length */
+lval* builtin_vdot(lenv* le, lval* lv) {
+  LASSERT_NUM("vdot", lv, 2);
+  LASSERT_TYPE("vdot", lv, 0, LVAL_VEC);
+  LASSERT_TYPE("vdot", lv, 1, LVAL_VEC);
+  LASSERT_NUMBERS("vdot", lv, 0);
+  LASSERT_NUMBERS("vdot", lv, 1);
+
+  lval* result = lvec_dot(lv->cell[0]->vec, lv->cell[1]->vec);
+  lval_del(lv);
+  return result;
+}
+
+/* (vec 1 2 3) packs values into a vector, unboxed when they are all
+ * numbers that fit a long or a double, and of floats if any of them is */
+lval* builtin_vec(lenv* le, lval* lv) {
+  int kind = LVEC_INT;
+
+  for (int i = 0; i < lv->length; i++) {
+    int type = lv->cell[i]->type;
+
+    if (type == LVAL_FLOAT && kind == LVEC_INT) {
+      kind = LVEC_FLOAT;
+    }
+
+    if (type != LVAL_NUM && type != LVAL_FLOAT) {
+      kind = LVEC_ANY;
+    }
+  }
+
+  lvec* vec = lvec_new(kind, lv->length);
+
+  for (int i = 0; i < lv->length; i++) {
+    switch (kind) {
+      case LVEC_ANY:
+        vec->cells[i] = lv->cell[i];
+        break;
+
+      case LVEC_FLOAT:
+        vec->flts[i] = lop_double(lv->cell[i]);
+        break;
+
+      case LVEC_INT:
+        vec->ints[i] = lv->cell[i]->num;
+        break;
+    }
+  }
+
+  /* boxed elements were moved into the vector */
+  if (kind == LVEC_ANY) {
+    lv->length = 0;
+  }
+
+  lval_del(lv);
+  return lval_vec(vec);
+}
+
+/* (vmap+ x y) adds two vectors of the same length element by element */
+lval* builtin_vmap_add(lenv* le, lval* lv) {
+  LASSERT_NUM("vmap+", lv, 2);
+  LASSERT_TYPE("vmap+", lv, 0, LVAL_VEC);
+  LASSERT_TYPE("vmap+", lv, 1, LVAL_VEC);
+  LASSERT_NUMBERS("vmap+", lv, 0);
+  LASSERT_NUMBERS("vmap+", lv, 1);
+
+  lval* result = lvec_add(lv->cell[0]->vec, lv->cell[1]->vec);
+  lval_del(lv);
+  return result;
+}
+
+lval* builtin_vmax(lenv* le, lval* lv) {
+  LASSERT_NUM("vmax", lv, 1);
+  LASSERT_TYPE("vmax", lv, 0, LVAL_VEC);
+  LASSERT_NUMBERS("vmax", lv, 0);
+  LASSERT(lv, lv->cell[0]->vec->length > 0,
+    "Function 'vmax' passed an empty vector.");
+
+  lval* result = lvec_extreme(lv->cell[0]->vec, 1);
+  lval_del(lv);
+  return result;
+}
+
+lval* builtin_vmin(lenv* le, lval* lv) {
+  LASSERT_NUM("vmin", lv, 1);
+  LASSERT_TYPE("vmin", lv, 0, LVAL_VEC);
+  LASSERT_NUMBERS("vmin", lv, 0);
+  LASSERT(lv, lv->cell[0]->vec->length > 0,
+    "Function 'vmin' passed an empty vector.");
+
+  lval* result = lvec_extreme(lv->cell[0]->vec, 0);
+  lval_del(lv);
+  return result;
+}
+
+/* (vrange to) or (vrange from to) is a vector of the integers from, or
+ * zero, up to but not including to */
+lval* builtin_vrange(lenv* le, lval* lv) {
+  LASSERT(lv, lv->length == 1 || lv->length == 2,
+    "Function 'vrange' passed incorrect number of arguments. "
+    "Got %i, expected 1 or 2.", lv->length);
+
+  for (int i = 0; i < lv->length; i++) {
+    LASSERT_TYPE("vrange", lv, i, LVAL_NUM);
+  }
+
+  long from = lv->length == 2 ? lv->cell[0]->num : 0;
+  long to = lv->cell[lv->length - 1]->num;
+  long length;
+
+  LASSERT(lv, !__builtin_sub_overflow(to, from, &length),
+    "Function 'vrange' passed a range too large.");
+
+  lvec* vec = lvec_new(LVEC_INT, length > 0 ? length : 0);
+
+  for (long i = 0; i < vec->length; i++) {
+    vec->ints[i] = from + i;
+  }
+
+  lval_del(lv);
+  return lval_vec(vec);
+}
+
+/* (vscale x k) multiplies every element of a vector by a number */
+lval* builtin_vscale(lenv* le, lval* lv) {
+  LASSERT_NUM("vscale", lv, 2);
+  LASSERT_TYPE("vscale", lv, 0, LVAL_VEC);
+  LASSERT_NUMBERS("vscale", lv, 0);
+  LASSERT(lv, lv->cell[1]->type == LVAL_NUM || lv->cell[1]->type == LVAL_BIG ||
+    lv->cell[1]->type == LVAL_FLOAT,
+    "Function 'vscale' passed incorrect type for argument 1. Got %s, expected %s.",
+    ltype_name(lv->cell[1]->type), ltype_name(LVAL_NUM));
+
+  lval* result = lvec_scale(lv->cell[0]->vec, lv->cell[1]);
+  lval_del(lv);
+  return result;
+}
+
+lval* builtin_vsum(lenv* le, lval* lv) {
+  LASSERT_NUM("vsum", lv, 1);
+  LASSERT_TYPE("vsum", lv, 0, LVAL_VEC);
+  LASSERT_NUMBERS("vsum", lv, 0);
+
+  lval* result = lvec_sum(lv->cell[0]->vec);
+  lval_del(lv);
+  return result;
+}
+
+/* special form, (while condition body) evaluates body while condition holds */
+lval* builtin_while(lenv* le, lval* lv) {
+  LCHECK(lv->length == 3,
+    "Function 'while' passed incorrect number of arguments. "
+    "Got %i, expected %i.", lv->length - 1, 2);
+
+  /* condition and body are evaluated in place on every iteration */
+  while (1) {
+    long truth;
+    lval* err = lval_exec_cond(le, lv->cell[1], "while", &truth);
+
+    if (err) {
+      return err;
+    }
+
+    if (!truth) {
+      break;
+    }
+
+    /* errors stop the loop, other results are discarded */
+    lval* acc = lval_exec_branch(le, lv->cell[2]);
+
+    if (acc->type == LVAL_ERR) {
+      return acc;
+    }
+
+    lval_del(acc);
+
+    /* each iteration is a back edge of the running lambda */
+    lopt_loop();
+  }
+
+  return lval_sexpr();
+}
+
 lval* builtin_var(lenv* le, lval* la, char* func) {
   LASSERT_TYPE(func, la, 0, LVAL_QEXPR);
 
@@ -223,14 +1244,313 @@ void lenv_add_builtins(lenv* le) {
   lenv_add_builtin(le, "list", builtin_list);
   lenv_add_builtin(le, "tail", builtin_tail);
 
+  /* Control forms */
+  lenv_add_builtin(le, "cond",  builtin_cond);
+  lenv_add_builtin(le, "if",    builtin_if);
+  lenv_add_builtin(le, "let",   builtin_let);
+  lenv_add_builtin(le, "while", builtin_while);
+
+  /* Comparison functions */
+  lenv_add_builtin(le, "==", builtin_eq);
+  lenv_add_builtin(le, ">=", builtin_ge);
+  lenv_add_builtin(le, ">",  builtin_gt);
+  lenv_add_builtin(le, "<=", builtin_le);
+  lenv_add_builtin(le, "<",  builtin_lt);
+  lenv_add_builtin(le, "!=", builtin_ne);
+
   /* Mathematical functions */
   lenv_add_builtin(le, "+", builtin_add);
   lenv_add_builtin(le, "/", builtin_div);
   lenv_add_builtin(le, "*", builtin_mul);
   lenv_add_builtin(le, "-", builtin_sub);
 
+  /* Compiler functions */
+  lenv_add_builtin(le, "jit", builtin_jit);
+
+  /* Vector functions */
+  lenv_add_builtin(le, "len",    builtin_len);
+  lenv_add_builtin(le, "nth",    builtin_nth);
+  lenv_add_builtin(le, "push",   builtin_push);
+  lenv_add_builtin(le, "pvec",   builtin_pvec);
+  lenv_add_builtin(le, "set",    builtin_set);
+  lenv_add_builtin(le, "slice",  builtin_slice);
+  lenv_add_builtin(le, "vdot",   builtin_vdot);
+  lenv_add_builtin(le, "vec",    builtin_vec);
+  lenv_add_builtin(le, "vmap+",  builtin_vmap_add);
+  lenv_add_builtin(le, "vmax",   builtin_vmax);
+  lenv_add_builtin(le, "vmin",   builtin_vmin);
+  lenv_add_builtin(le, "vrange", builtin_vrange);
+  lenv_add_builtin(le, "vscale", builtin_vscale);
+  lenv_add_builtin(le, "vsum",   builtin_vsum);
+
+  /* Map functions */
+  lenv_add_builtin(le, "hdel",  builtin_hdel);
+  lenv_add_builtin(le, "hget",  builtin_hget);
+  lenv_add_builtin(le, "hkeys", builtin_hkeys);
+  lenv_add_builtin(le, "hmap",  builtin_hmap);
+  lenv_add_builtin(le, "hset",  builtin_hset);
+  lenv_add_builtin(le, "hsize", builtin_hsize);
+
+  /* Persistent map functions */
+  lenv_add_builtin(le, "pdel",  builtin_pdel);
+  lenv_add_builtin(le, "pget",  builtin_pget);
+  lenv_add_builtin(le, "pkeys", builtin_pkeys);
+  lenv_add_builtin(le, "pmap",  builtin_pmap);
+  lenv_add_builtin(le, "pset",  builtin_pset);
+  lenv_add_builtin(le, "psize", builtin_psize);
+
+  /* Lazy evaluation functions */
+  lenv_add_builtin(le, "delay",  builtin_delay);
+  lenv_add_builtin(le, "force",  builtin_force);
+  lenv_add_builtin(le, "lcons",  builtin_lcons);
+  lenv_add_builtin(le, "lrange", builtin_lrange);
+  lenv_add_builtin(le, "ltail",  builtin_ltail);
+  lenv_add_builtin(le, "ltake",  builtin_ltake);
+
+  /* Memoization functions */
+  lenv_add_builtin(le, "memo",       builtin_memo);
+  lenv_add_builtin(le, "memo-stats", builtin_memo_stats);
+
+  /* Profiling functions */
+  lenv_add_builtin(le, "fusion-table", builtin_fusion_table);
+  lenv_add_builtin(le, "profile",      builtin_profile);
+  lenv_add_builtin(le, "tier-stats",   builtin_tier_stats);
+
   /* variable functions */
   lenv_add_builtin(le, "=",   builtin_put);
   lenv_add_builtin(le, "\\", builtin_lambda);
   lenv_add_builtin(le, "def",  builtin_def);
 }
+
+/* check if a value is a special form, which reads its whole expression
+ * unevaluated and without taking ownership of it */
+int builtin_special(lval* lv) {
+  if (lv->type != LVAL_FUNC || !lv->builtin) {
+    return 0;
+  }
+
+  return lv->builtin == builtin_cond || lv->builtin == builtin_if ||
+         lv->builtin == builtin_let  || lv->builtin == builtin_while;
+}
+
+/* operator code of an arithmetic builtin, -1 for any other value */
+int lop_code(lval* lv) {
+  if (lv->type != LVAL_FUNC || !lv->builtin) {
+    return -1;
+  }
+
+  if (lv->builtin == builtin_add) { return LOP_ADD; }
+  if (lv->builtin == builtin_div) { return LOP_DIV; }
+  if (lv->builtin == builtin_eq)  { return LOP_EQ; }
+  if (lv->builtin == builtin_ge)  { return LOP_GE; }
+  if (lv->builtin == builtin_gt)  { return LOP_GT; }
+  if (lv->builtin == builtin_le)  { return LOP_LE; }
+  if (lv->builtin == builtin_lt)  { return LOP_LT; }
+  if (lv->builtin == builtin_mul) { return LOP_MUL; }
+  if (lv->builtin == builtin_ne)  { return LOP_NE; }
+  if (lv->builtin == builtin_sub) { return LOP_SUB; }
+
+  return -1;
+}
+
+/* fold a vector of numbers with an operator into acc, returns 0 if the
+ * operator divides by zero and -1 if the result does not fit in a long */
+int lop_fold(int op, long* x, int length, long* acc) {
+  long result = x[0];
+
+  /* the operator is dispatched once, each case runs its own loop */
+  switch (op) {
+
+    case LOP_ADD:
+    case LOP_SUB:
+      /* if no arguments and sub then perform unary negation */
+      if (op == LOP_SUB && length == 1 &&
+          __builtin_sub_overflow(0, result, &result)) {
+        return -1;
+      }
+
+      /* the rest of a long fold is summed in vector lanes first, a lane
+       * that overflows sends it to big integers even if the total fits */
+      if (length > LOP_WIDE) {
+        long rest;
+
+        if (!lvec_sum_ints(x + 1, length - 1, &rest) ||
+            (op == LOP_ADD ? __builtin_add_overflow(result, rest, &result)
+                           : __builtin_sub_overflow(result, rest, &result))) {
+          return -1;
+        }
+        break;
+      }
+
+      if (op == LOP_ADD) {
+        for (int i = 1; i < length; i++) {
+          if (__builtin_add_overflow(result, x[i], &result)) { return -1; }
+        }
+        break;
+      }
+
+      for (int i = 1; i < length; i++) {
+        if (__builtin_sub_overflow(result, x[i], &result)) { return -1; }
+      }
+      break;
+
+    case LOP_MUL:
+      for (int i = 1; i < length; i++) {
+        if (__builtin_mul_overflow(result, x[i], &result)) { return -1; }
+      }
+      break;
+
+    case LOP_DIV:
+      for (int i = 1; i < length; i++) {
+        if (x[i] == 0) {
+          return 0;
+        }
+
+        /* the one quotient that overflows */
+        if (x[i] == -1 && result == LONG_MIN) {
+          return -1;
+        }
+
+        result /= x[i];
+      }
+      break;
+
+    /* comparisons hold if they hold for every consecutive pair */
+    case LOP_EQ:
+      result = 1;
+      for (int i = 1; i < length && result; i++) { result = x[i - 1] == x[i]; }
+      break;
+
+    case LOP_GE:
+      result = 1;
+      for (int i = 1; i < length && result; i++) { result = x[i - 1] >= x[i]; }
+      break;
+
+    case LOP_GT:
+      result = 1;
+      for (int i = 1; i < length && result; i++) { result = x[i - 1] > x[i]; }
+      break;
+
+    case LOP_LE:
+      result = 1;
+      for (int i = 1; i < length && result; i++) { result = x[i - 1] <= x[i]; }
+      break;
+
+    case LOP_LT:
+      result = 1;
+      for (int i = 1; i < length && result; i++) { result = x[i - 1] < x[i]; }
+      break;
+
+    case LOP_NE:
+      result = 1;
+      for (int i = 1; i < length && result; i++) { result = x[i - 1] != x[i]; }
+      break;
+  }
+
+  *acc = result;
+  return 1;
+}
+
+/* fold a vector of floats with an operator into acc, returns 0 if the
+ * operator divides by zero and -1 if the result is not finite */
+int lop_fold_float(int op, double* x, int length, double* acc) {
+  double result = x[0];
+
+  switch (op) {
+
+    case LOP_ADD:
+      for (int i = 1; i < length; i++) { result += x[i]; }
+      break;
+
+    case LOP_SUB:
+      /* if no arguments and sub then perform unary negation */
+      if (length == 1) { result = -result; }
+      for (int i = 1; i < length; i++) { result -= x[i]; }
+      break;
+
+    case LOP_MUL:
+      for (int i = 1; i < length; i++) { result *= x[i]; }
+      break;
+
+    case LOP_DIV:
+      for (int i = 1; i < length; i++) {
+        if (x[i] == 0) {
+          return 0;
+        }
+
+        result /= x[i];
+      }
+      break;
+
+    /* comparisons hold if they hold for every consecutive pair */
+    case LOP_EQ:
+      result = 1;
+      for (int i = 1; i < length && result; i++) { result = x[i - 1] == x[i]; }
+      break;
+
+    case LOP_GE:
+      result = 1;
+      for (int i = 1; i < length && result; i++) { result = x[i - 1] >= x[i]; }
+      break;
+
+    case LOP_GT:
+      result = 1;
+      for (int i = 1; i < length && result; i++) { result = x[i - 1] > x[i]; }
+      break;
+
+    case LOP_LE:
+      result = 1;
+      for (int i = 1; i < length && result; i++) { result = x[i - 1] <= x[i]; }
+      break;
+
+    case LOP_LT:
+      result = 1;
+      for (int i = 1; i < length && result; i++) { result = x[i - 1] < x[i]; }
+      break;
+
+    case LOP_NE:
+      result = 1;
+      for (int i = 1; i < length && result; i++) { result = x[i - 1] != x[i]; }
+      break;
+  }
+
+  *acc = result;
+  return isfinite(result) ? 1 : -1;
+}
+
+char* lop_name(int op) {
+  switch (op) {
+    case LOP_ADD:
+      return "+";
+
+    case LOP_DIV:
+      return "/";
+
+    case LOP_EQ:
+      return "==";
+
+    case LOP_GE:
+      return ">=";
+
+    case LOP_GT:
+      return ">";
+
+    case LOP_LE:
+      return "<=";
+
+    case LOP_LT:
+      return "<";
+
+    case LOP_MUL:
+      return "*";
+
+    case LOP_NE:
+      return "!=";
+
+    case LOP_SUB:
+      return "-";
+
+    default:
+      return "Unknown";
+  }
+}
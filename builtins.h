@@ -5,20 +5,94 @@
 #include "lval.h"
 
 
+/* arithmetic and comparison operators understood by builtin_op */
+enum {
+  LOP_ADD,
+  LOP_DIV,
+  LOP_EQ,
+  LOP_GE,
+  LOP_GT,
+  LOP_LE,
+  LOP_LT,
+  LOP_MUL,
+  LOP_NE,
+  LOP_SUB,
+};
+
+/* operands up to this count are folded without touching the heap */
+#define LOP_SCRATCH 8
+
+/* sums of more operands than this are reduced with vector instructions */
+#define LOP_WIDE 32
+
+char* lop_name(int);
+int builtin_special(lval*);
+int lop_code(lval*);
+int lop_fold(int, long*, int, long*);
+int lop_fold_float(int, double*, int, double*);
+
 lval* builtin_add(lenv*, lval*);
+lval* builtin_cond(lenv*, lval*);
 lval* builtin_def(lenv*, lval*);
 lval* builtin_def(lenv*, lval*);
+lval* builtin_delay(lenv*, lval*);
 lval* builtin_div(lenv*, lval*);
+lval* builtin_eq(lenv*, lval*);
 lval* builtin_eval(lenv*, lval*);
+lval* builtin_force(lenv*, lval*);
+lval* builtin_fusion_table(lenv*, lval*);
+lval* builtin_ge(lenv*, lval*);
+lval* builtin_gt(lenv*, lval*);
+lval* builtin_hdel(lenv*, lval*);
 lval* builtin_head(lenv*, lval*);
+lval* builtin_hget(lenv*, lval*);
+lval* builtin_hkeys(lenv*, lval*);
+lval* builtin_hmap(lenv*, lval*);
+lval* builtin_hset(lenv*, lval*);
+lval* builtin_hsize(lenv*, lval*);
+lval* builtin_if(lenv*, lval*);
+lval* builtin_jit(lenv*, lval*);
 lval* builtin_join(lenv*, lval*);
+lval* builtin_lcons(lenv*, lval*);
+lval* builtin_le(lenv*, lval*);
+lval* builtin_len(lenv*, lval*);
+lval* builtin_let(lenv*, lval*);
 lval* builtin_list(lenv*, lval*);
+lval* builtin_lrange(lenv*, lval*);
+lval* builtin_lt(lenv*, lval*);
+lval* builtin_ltail(lenv*, lval*);
+lval* builtin_ltake(lenv*, lval*);
+lval* builtin_memo(lenv*, lval*);
+lval* builtin_memo_stats(lenv*, lval*);
 lval* builtin_mul(lenv*, lval*);
-lval* builtin_op(lenv*, lval*, char*);
+lval* builtin_ne(lenv*, lval*);
+lval* builtin_nth(lenv*, lval*);
+lval* builtin_op(lenv*, lval*, int);
+lval* builtin_pdel(lenv*, lval*);
+lval* builtin_pget(lenv*, lval*);
+lval* builtin_pkeys(lenv*, lval*);
+lval* builtin_pmap(lenv*, lval*);
+lval* builtin_profile(lenv*, lval*);
+lval* builtin_pset(lenv*, lval*);
+lval* builtin_psize(lenv*, lval*);
+lval* builtin_push(lenv*, lval*);
 lval* builtin_put(lenv*, lval*);
+lval* builtin_pvec(lenv*, lval*);
+lval* builtin_set(lenv*, lval*);
+lval* builtin_slice(lenv*, lval*);
 lval* builtin_sub(lenv*, lval*);
 lval* builtin_tail(lenv*, lval*);
+lval* builtin_tier_stats(lenv*, lval*);
 lval* builtin_var(lenv*, lval*, char*);
+lval* builtin_vdot(lenv*, lval*);
+lval* builtin_vec(lenv*, lval*);
+lval* builtin_vmap_add(lenv*, lval*);
+lval* builtin_vmax(lenv*, lval*);
+lval* builtin_vmin(lenv*, lval*);
+lval* builtin_vrange(lenv*, lval*);
+lval* builtin_vscale(lenv*, lval*);
+lval* builtin_vsum(lenv*, lval*);
+lval* builtin_while(lenv*, lval*);
 
 void lenv_add_builtin(lenv*, char*, lbuiltin);
 void lenv_add_builtins(lenv*);
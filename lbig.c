@@ -0,0 +1,595 @@
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "builtins.h"
+#include "lbig.h"
+#include "lbuf.h"
+#include "lval.h"
+
+
+static lbig* lbig_new(int length) {
+  lbig* lb = malloc(sizeof(lbig) + sizeof(uint32_t) * length);
+  lb->refs = 1;
+  lb->sign = 1;
+  lb->length = length;
+  memset(lb->limb, 0, sizeof(uint32_t) * length);
+  return lb;
+}
+
+/* drop leading zero limbs, zero is always positive */
+static lbig* lbig_trim(lbig* lb) {
+  while (lb->length > 0 && lb->limb[lb->length - 1] == 0) {
+    lb->length--;
+  }
+
+  if (lb->length == 0) {
+    lb->sign = 1;
+  }
+
+  return lb;
+}
+
+/* r += x, r has room for any carry out of x */
+static void lbig_mag_add(uint32_t* r, int rn, uint32_t* x, int xn) {
+  uint64_t carry = 0;
+  int i = 0;
+
+  for (; i < xn; i++) {
+    carry += (uint64_t) r[i] + x[i];
+    r[i] = (uint32_t) carry;
+    carry >>= 32;
+  }
+
+  for (; carry && i < rn; i++) {
+    carry += r[i];
+    r[i] = (uint32_t) carry;
+    carry >>= 32;
+  }
+}
+
+/* r -= x, r is at least x */
+static void lbig_mag_sub(uint32_t* r, int rn, uint32_t* x, int xn) {
+  int64_t borrow = 0;
+  int i = 0;
+
+  for (; i < xn; i++) {
+    int64_t d = (int64_t) r[i] - x[i] - borrow;
+    borrow = d < 0;
+    r[i] = (uint32_t) d;
+  }
+
+  for (; borrow && i < rn; i++) {
+    int64_t d = (int64_t) r[i] - borrow;
+    borrow = d < 0;
+    r[i] = (uint32_t) d;
+  }
+}
+
+static int lbig_mag_cmp(uint32_t* x, int xn, uint32_t* y, int yn) {
+  while (xn > 0 && x[xn - 1] == 0) { xn--; }
+  while (yn > 0 && y[yn - 1] == 0) { yn--; }
+
+  if (xn != yn) {
+    return xn < yn ? -1 : 1;
+  }
+
+  for (int i = xn - 1; i >= 0; i--) {
+    if (x[i] != y[i]) {
+      return x[i] < y[i] ? -1 : 1;
+    }
+  }
+
+  return 0;
+}
+
+/* r = x * y, r holds xn + yn zeroed limbs. Operands of at least
+ * LBIG_KARATSUBA limbs are split in halves and multiplied with three
+ * products instead of four */
+static void lbig_mag_mul(uint32_t* r, uint32_t* x, int xn,
+                         uint32_t* y, int yn) {
+
+  if (xn < yn) {
+    uint32_t* t = x; x = y; y = t;
+    int tn = xn; xn = yn; yn = tn;
+  }
+
+  if (yn < LBIG_KARATSUBA) {
+    for (int i = 0; i < yn; i++) {
+      uint64_t carry = 0;
+
+      for (int j = 0; j < xn; j++) {
+        carry += (uint64_t) y[i] * x[j] + r[i + j];
+        r[i + j] = (uint32_t) carry;
+        carry >>= 32;
+      }
+
+      r[i + xn] = (uint32_t) carry;
+    }
+    return;
+  }
+
+  /* unbalanced operands are multiplied a slice of the longer at a time */
+  if (2 * yn <= xn) {
+    uint32_t* t = malloc(sizeof(uint32_t) * 2 * yn);
+
+    for (int i = 0; i < xn; i += yn) {
+      int n = xn - i < yn ? xn - i : yn;
+
+      memset(t, 0, sizeof(uint32_t) * 2 * yn);
+      lbig_mag_mul(t, x + i, n, y, yn);
+      lbig_mag_add(r + i, xn + yn - i, t, n + yn);
+    }
+
+    free(t);
+    return;
+  }
+
+  /* x = x1 B^m + x0 and y = y1 B^m + y0, then
+   * x y = z2 B^2m + ((x0 + x1)(y0 + y1) - z2 - z0) B^m + z0 */
+  int m = xn / 2;
+  int n1 = xn - m;
+  int n2 = yn - m;
+
+  int sxn = n1 + 1;
+  int syn = (n2 > m ? n2 : m) + 1;
+
+  uint32_t* sx = calloc(sxn, sizeof(uint32_t));
+  uint32_t* sy = calloc(syn, sizeof(uint32_t));
+  memcpy(sx, x, sizeof(uint32_t) * m);
+  memcpy(sy, y, sizeof(uint32_t) * m);
+  lbig_mag_add(sx, sxn, x + m, n1);
+  lbig_mag_add(sy, syn, y + m, n2);
+
+  uint32_t* z0 = calloc(2 * m, sizeof(uint32_t));
+  uint32_t* z1 = calloc(sxn + syn, sizeof(uint32_t));
+  uint32_t* z2 = calloc(n1 + n2, sizeof(uint32_t));
+
+  lbig_mag_mul(z0, x, m, y, m);
+  lbig_mag_mul(z1, sx, sxn, sy, syn);
+  lbig_mag_mul(z2, x + m, n1, y + m, n2);
+
+  lbig_mag_sub(z1, sxn + syn, z0, 2 * m);
+  lbig_mag_sub(z1, sxn + syn, z2, n1 + n2);
+
+  /* the middle term fits below the top of the product */
+  int z1n = sxn + syn;
+  while (z1n > 0 && z1[z1n - 1] == 0) { z1n--; }
+
+  lbig_mag_add(r, xn + yn, z0, 2 * m);
+  lbig_mag_add(r + m, xn + yn - m, z1, z1n);
+  lbig_mag_add(r + 2 * m, xn + yn - 2 * m, z2, n1 + n2);
+
+  free(sx);
+  free(sy);
+  free(z0);
+  free(z1);
+  free(z2);
+}
+
+/* q = x / y for magnitudes, y has at least two limbs and x at least as
+ * many. Knuth's algorithm D on normalized operands */
+static void lbig_mag_div(uint32_t* q, uint32_t* x, int m,
+                         uint32_t* y, int n) {
+
+  int s = __builtin_clz(y[n - 1]);
+
+  uint32_t* yn = malloc(sizeof(uint32_t) * n);
+  uint32_t* xn = malloc(sizeof(uint32_t) * (m + 1));
+
+  for (int i = n - 1; i > 0; i--) {
+    yn[i] = (y[i] << s) | (uint32_t) ((uint64_t) y[i - 1] >> (32 - s));
+  }
+  yn[0] = y[0] << s;
+
+  xn[m] = (uint32_t) ((uint64_t) x[m - 1] >> (32 - s));
+  for (int i = m - 1; i > 0; i--) {
+    xn[i] = (x[i] << s) | (uint32_t) ((uint64_t) x[i - 1] >> (32 - s));
+  }
+  xn[0] = x[0] << s;
+
+  for (int j = m - n; j >= 0; j--) {
+
+    /* estimate the quotient digit from the top two limbs */
+    uint64_t top = ((uint64_t) xn[j + n] << 32) | xn[j + n - 1];
+    uint64_t qhat = top / yn[n - 1];
+    uint64_t rhat = top % yn[n - 1];
+
+    while (qhat >> 32 ||
+           qhat * yn[n - 2] > ((rhat << 32) | xn[j + n - 2])) {
+      qhat--;
+      rhat += yn[n - 1];
+
+      if (rhat >> 32) {
+        break;
+      }
+    }
+
+    /* multiply and subtract */
+    int64_t k = 0;
+    int64_t t;
+
+    for (int i = 0; i < n; i++) {
+      uint64_t p = qhat * yn[i];
+      t = (int64_t) xn[i + j] - k - (int64_t) (p & 0xFFFFFFFF);
+      xn[i + j] = (uint32_t) t;
+      k = (int64_t) (p >> 32) - (t >> 32);
+    }
+
+    t = (int64_t) xn[j + n] - k;
+    xn[j + n] = (uint32_t) t;
+    q[j] = (uint32_t) qhat;
+
+    /* the estimate was one too large, add back */
+    if (t < 0) {
+      uint64_t carry = 0;
+      q[j]--;
+
+      for (int i = 0; i < n; i++) {
+        carry += (uint64_t) xn[i + j] + yn[i];
+        xn[i + j] = (uint32_t) carry;
+        carry >>= 32;
+      }
+
+      xn[j + n] += (uint32_t) carry;
+    }
+  }
+
+  free(yn);
+  free(xn);
+}
+
+/* divide a magnitude in place by a single limb, returning the remainder */
+static uint32_t lbig_mag_div1(uint32_t* x, int xn, uint32_t d) {
+  uint64_t rem = 0;
+
+  for (int i = xn - 1; i >= 0; i--) {
+    uint64_t cur = (rem << 32) | x[i];
+    x[i] = (uint32_t) (cur / d);
+    rem = cur % d;
+  }
+
+  return (uint32_t) rem;
+}
+
+static lbig* lbig_add(lbig* x, lbig* y, int negate) {
+  int ysign = negate ? -y->sign : y->sign;
+
+  /* same signs add magnitudes */
+  if (x->sign == ysign) {
+    lbig* big = x->length > y->length ? x : y;
+    lbig* small = big == x ? y : x;
+
+    lbig* r = lbig_new(big->length + 1);
+    memcpy(r->limb, big->limb, sizeof(uint32_t) * big->length);
+    lbig_mag_add(r->limb, r->length, small->limb, small->length);
+    r->sign = x->sign;
+    return lbig_trim(r);
+  }
+
+  /* otherwise the smaller magnitude is taken from the larger */
+  int cmp = lbig_mag_cmp(x->limb, x->length, y->limb, y->length);
+  lbig* big = cmp >= 0 ? x : y;
+  lbig* small = big == x ? y : x;
+
+  lbig* r = lbig_new(big->length);
+  memcpy(r->limb, big->limb, sizeof(uint32_t) * big->length);
+  lbig_mag_sub(r->limb, r->length, small->limb, small->length);
+  r->sign = big == x ? x->sign : ysign;
+  return lbig_trim(r);
+}
+
+/* quotient truncated towards zero, like C division */
+static lbig* lbig_div(lbig* x, lbig* y) {
+  lbig* r;
+
+  if (lbig_mag_cmp(x->limb, x->length, y->limb, y->length) < 0) {
+    return lbig_new(0);
+  }
+
+  if (y->length == 1) {
+    r = lbig_new(x->length);
+    memcpy(r->limb, x->limb, sizeof(uint32_t) * x->length);
+    lbig_mag_div1(r->limb, r->length, y->limb[0]);
+  } else {
+    r = lbig_new(x->length - y->length + 1);
+    lbig_mag_div(r->limb, x->limb, x->length, y->limb, y->length);
+  }
+
+  r->sign = x->sign * y->sign;
+  return lbig_trim(r);
+}
+
+static lbig* lbig_mul(lbig* x, lbig* y) {
+  lbig* r = lbig_new(x->length + y->length);
+  lbig_mag_mul(r->limb, x->limb, x->length, y->limb, y->length);
+  r->sign = x->sign * y->sign;
+  return lbig_trim(r);
+}
+
+/* take a reference to the value of a number */
+static lbig* lbig_of(lval* lv) {
+  if (lv->type == LVAL_BIG) {
+    lv->big->refs++;
+    return lv->big;
+  }
+
+  return lbig_long(lv->num);
+}
+
+
+int lbig_cmp(lbig* x, lbig* y) {
+  if (x->sign != y->sign) {
+    return x->sign;
+  }
+
+  return x->sign * lbig_mag_cmp(x->limb, x->length, y->limb, y->length);
+}
+
+void lbig_del(lbig* lb) {
+  if (--lb->refs > 0) {
+    return;
+  }
+
+  free(lb);
+}
+
+/* nearest double, accumulated from the most significant limb down */
+double lbig_double(lbig* lb) {
+  double d = 0;
+
+  for (int i = lb->length - 1; i >= 0; i--) {
+    d = d * 4294967296.0 + lb->limb[i];
+  }
+
+  return lb->sign * d;
+}
+
+unsigned long lbig_hash(lbig* lb) {
+  unsigned long hash = lb->sign;
+
+  for (int i = 0; i < lb->length; i++) {
+    hash = hash * 1099511628211UL ^ lb->limb[i];
+  }
+
+  return hash;
+}
+
+lbig* lbig_long(long num) {
+  unsigned long mag = num < 0 ? -(unsigned long) num : (unsigned long) num;
+
+  lbig* lb = lbig_new(2);
+  lb->limb[0] = (uint32_t) mag;
+  lb->limb[1] = (uint32_t) (mag >> 32);
+  lb->sign = num < 0 ? -1 : 1;
+  return lbig_trim(lb);
+}
+
+/* fold numbers of either size with an operator, like lop_fold */
+lval* lbig_op(int op, lval** cell, int length) {
+  lbig* acc = lbig_of(cell[0]);
+
+  /* if no arguments and sub then perform unary negation */
+  if (op == LOP_SUB && length == 1) {
+    lbig* zero = lbig_new(0);
+    lbig* r = lbig_add(zero, acc, 1);
+    lbig_del(zero);
+    lbig_del(acc);
+    return lbig_value(r);
+  }
+
+  int truth = 1;
+
+  for (int i = 1; i < length; i++) {
+    lbig* x = lbig_of(cell[i]);
+    lbig* r = NULL;
+
+    switch (op) {
+      case LOP_ADD: r = lbig_add(acc, x, 0); break;
+      case LOP_SUB: r = lbig_add(acc, x, 1); break;
+      case LOP_MUL: r = lbig_mul(acc, x); break;
+
+      case LOP_DIV:
+        if (x->length == 0) {
+          lbig_del(acc);
+          lbig_del(x);
+          return lval_err("Division by zero!");
+        }
+
+        r = lbig_div(acc, x);
+        break;
+
+      /* comparisons hold if they hold for every consecutive pair */
+      case LOP_EQ: truth = truth && lbig_cmp(acc, x) == 0; break;
+      case LOP_GE: truth = truth && lbig_cmp(acc, x) >= 0; break;
+      case LOP_GT: truth = truth && lbig_cmp(acc, x) >  0; break;
+      case LOP_LE: truth = truth && lbig_cmp(acc, x) <= 0; break;
+      case LOP_LT: truth = truth && lbig_cmp(acc, x) <  0; break;
+      case LOP_NE: truth = truth && lbig_cmp(acc, x) != 0; break;
+    }
+
+    /* comparisons move on to the next pair */
+    if (!r) {
+      r = x;
+      x->refs++;
+    }
+
+    lbig_del(acc);
+    lbig_del(x);
+    acc = r;
+  }
+
+  switch (op) {
+    case LOP_ADD:
+    case LOP_DIV:
+    case LOP_MUL:
+    case LOP_SUB:
+      return lbig_value(acc);
+  }
+
+  lbig_del(acc);
+  return lval_num(truth);
+}
+
+/* write a magnitude in decimal, nine digits at a time found with one pass
+ * of single limb division each, zero padded to digits when it is set */
+static void lbig_write_small(lbuf* out, lbig* lb, long digits) {
+  int length = lb->length;
+
+  uint32_t* mag = malloc(sizeof(uint32_t) * (length + 1));
+  memcpy(mag, lb->limb, sizeof(uint32_t) * length);
+
+  /* every limb holds a little under ten digits */
+  uint32_t* chunks = malloc(sizeof(uint32_t) * (length * 10 / 9 + 2));
+  int count = 0;
+
+  while (length > 0) {
+    chunks[count++] = lbig_mag_div1(mag, length, 1000000000);
+
+    while (length > 0 && mag[length - 1] == 0) {
+      length--;
+    }
+  }
+
+  for (long i = count; i < digits / 9; i++) {
+    lbuf_ulong(out, 0, 9);
+  }
+
+  for (int i = count - 1; i >= 0; i--) {
+    lbuf_ulong(out, chunks[i], digits || i < count - 1 ? 9 : 0);
+  }
+
+  free(mag);
+  free(chunks);
+}
+
+/* write a magnitude in decimal, zero padded to digits when it is set.
+ * Long ones are split by the largest power[k] = 10^(9 * 2^k) they reach
+ * into a quotient and a remainder of 9 * 2^k digits, which are written
+ * the same way. Dividing in halves replaces the one pass over the whole
+ * number for every nine digits */
+static void lbig_write_split(lbuf* out, lbig* lb, lbig** power, int k,
+                             long digits) {
+
+  while (k >= 0 && lbig_mag_cmp(lb->limb, lb->length,
+                                power[k]->limb, power[k]->length) < 0) {
+    k--;
+  }
+
+  if (k < 0 || lb->length < LBIG_SPLIT) {
+    lbig_write_small(out, lb, digits);
+    return;
+  }
+
+  lbig* q = lbig_div(lb, power[k]);
+  lbig* p = lbig_mul(q, power[k]);
+  lbig* r = lbig_add(lb, p, 1);
+  long low = 9L << k;
+
+  lbig_write_split(out, q, power, k - 1, digits ? digits - low : 0);
+  lbig_write_split(out, r, power, k - 1, low);
+
+  lbig_del(q);
+  lbig_del(p);
+  lbig_del(r);
+}
+
+void lbig_write(lbuf* out, lbig* lb) {
+  if (lb->length == 0) {
+    lbuf_char(out, '0');
+    return;
+  }
+
+  if (lb->sign < 0) {
+    lbuf_char(out, '-');
+  }
+
+  if (lb->length < LBIG_SPLIT) {
+    lbig_write_small(out, lb, 0);
+    return;
+  }
+
+  /* the powers of ten squared up to at least the square root */
+  lbig* power[32];
+  int count = 1;
+  power[0] = lbig_long(1000000000);
+
+  while (2 * power[count - 1]->length - 1 <= lb->length) {
+    power[count] = lbig_mul(power[count - 1], power[count - 1]);
+    count++;
+  }
+
+  lbig* mag = lbig_new(lb->length);
+  memcpy(mag->limb, lb->limb, sizeof(uint32_t) * lb->length);
+
+  lbig_write_split(out, mag, power, count - 1, 0);
+  lbig_del(mag);
+
+  for (int i = 0; i < count; i++) {
+    lbig_del(power[i]);
+  }
+}
+
+/* read a decimal integer of any length, nine digits at a time */
+lbig* lbig_read(char* s) {
+  int sign = 1;
+
+  if (*s == '-') {
+    sign = -1;
+    s++;
+  }
+
+  int digits = strlen(s);
+  lbig* lb = lbig_new(digits / 9 + 2);
+  int length = 0;
+
+  while (*s) {
+    uint32_t chunk = 0;
+    uint32_t scale = 1;
+
+    for (int i = 0; i < 9 && *s; i++, s++) {
+      chunk = chunk * 10 + (*s - '0');
+      scale *= 10;
+    }
+
+    /* shift what was read so far by the chunk and add it */
+    uint64_t carry = chunk;
+
+    for (int i = 0; i < length; i++) {
+      carry += (uint64_t) lb->limb[i] * scale;
+      lb->limb[i] = (uint32_t) carry;
+      carry >>= 32;
+    }
+
+    if (carry) {
+      lb->limb[length++] = (uint32_t) carry;
+    }
+  }
+
+  lb->length = length;
+  lb->sign = sign;
+  return lbig_trim(lb);
+}
+
+/* box a result, demoting it to a plain number when it fits in a long */
+lval* lbig_value(lbig* lb) {
+  if (lb->length <= 2) {
+    uint64_t mag = lb->length > 0 ? lb->limb[0] : 0;
+
+    if (lb->length == 2) {
+      mag |= (uint64_t) lb->limb[1] << 32;
+    }
+
+    if (lb->sign > 0 && mag <= LONG_MAX) {
+      lbig_del(lb);
+      return lval_num((long) mag);
+    }
+
+    if (lb->sign < 0 && mag <= (uint64_t) LONG_MAX + 1) {
+      lbig_del(lb);
+      return lval_num((long) -(mag - 1) - 1);
+    }
+  }
+
+  return lval_big(lb);
+}
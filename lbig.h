@@ -0,0 +1,41 @@
+#ifndef LBIG_H_
+#define LBIG_H_
+
+#include <stdint.h>
+
+#include "lval.h"
+
+
+/* limbs from which multiplication switches to Karatsuba */
+#define LBIG_KARATSUBA 32
+
+/* limbs from which writing in decimal splits a number in halves */
+#define LBIG_SPLIT 64
+
+/* integer too large for a long, immutable and shared between copies.
+ * The magnitude is stored in base 2^32, least significant limb first,
+ * without leading zero limbs */
+typedef struct lbig {
+  int refs;
+  int sign;
+  int length;
+  uint32_t limb[];
+} lbig;
+
+
+double lbig_double(lbig*);
+
+int lbig_cmp(lbig*, lbig*);
+
+lbig* lbig_long(long);
+lbig* lbig_read(char*);
+
+lval* lbig_op(int, lval**, int);
+lval* lbig_value(lbig*);
+
+unsigned long lbig_hash(lbig*);
+
+void lbig_del(lbig*);
+void lbig_write(struct lbuf*, lbig*);
+
+#endif
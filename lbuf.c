@@ -0,0 +1,81 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "lbuf.h"
+
+
+/* make room for count more characters and a terminating NUL */
+static void lbuf_reserve(lbuf* lb, int count) {
+  if (lb->length + count < lb->capacity) {
+    return;
+  }
+
+  while (lb->length + count >= lb->capacity) {
+    lb->capacity = lb->capacity ? lb->capacity * 2 : 64;
+  }
+
+  lb->data = realloc(lb->data, lb->capacity);
+}
+
+
+void lbuf_char(lbuf* lb, char c) {
+  if (lb->length + 1 >= lb->capacity) {
+    lbuf_reserve(lb, 1);
+  }
+
+  lb->data[lb->length++] = c;
+}
+
+/* write the contents out in one go and empty the buffer, keeping its
+ * memory for the next use */
+void lbuf_flush(lbuf* lb, FILE* out) {
+  if (lb->length > 0) {
+    fwrite(lb->data, 1, lb->length, out);
+  }
+
+  lb->length = 0;
+}
+
+void lbuf_long(lbuf* lb, long num) {
+  if (num < 0) {
+    lbuf_char(lb, '-');
+    lbuf_ulong(lb, -(unsigned long) num, 0);
+  } else {
+    lbuf_ulong(lb, num, 0);
+  }
+}
+
+void lbuf_str(lbuf* lb, char* str) {
+  lbuf_write(lb, str, strlen(str));
+}
+
+/* the contents as a NUL terminated string owned by the buffer */
+char* lbuf_string(lbuf* lb) {
+  lbuf_reserve(lb, 0);
+  lb->data[lb->length] = '\0';
+  return lb->data;
+}
+
+/* decimal digits of a number, padded with zeros to at least width */
+void lbuf_ulong(lbuf* lb, unsigned long num, int width) {
+  char digits[24];
+  int count = 0;
+
+  do {
+    digits[sizeof(digits) - ++count] = '0' + num % 10;
+    num /= 10;
+  } while (num > 0);
+
+  while (count < width && count < (int) sizeof(digits)) {
+    digits[sizeof(digits) - ++count] = '0';
+  }
+
+  lbuf_write(lb, digits + sizeof(digits) - count, count);
+}
+
+void lbuf_write(lbuf* lb, char* str, int count) {
+  lbuf_reserve(lb, count);
+  memcpy(lb->data + lb->length, str, count);
+  lb->length += count;
+}
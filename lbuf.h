@@ -0,0 +1,25 @@
+#ifndef LBUF_H_
+#define LBUF_H_
+
+#include <stdio.h>
+
+
+/* growable text buffer values are written into, so they reach the output
+ * in a single write or can be kept as a string */
+typedef struct lbuf {
+  int length;
+  int capacity;
+  char* data;
+} lbuf;
+
+
+char* lbuf_string(lbuf*);
+
+void lbuf_char(lbuf*, char);
+void lbuf_flush(lbuf*, FILE*);
+void lbuf_long(lbuf*, long);
+void lbuf_str(lbuf*, char*);
+void lbuf_ulong(lbuf*, unsigned long, int);
+void lbuf_write(lbuf*, char*, int);
+
+#endif
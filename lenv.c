@@ -2,9 +2,41 @@
 #include <string.h>
 
 #include "lenv.h"
+#include "lopt.h"
 #include "lval.h"
 
 
+/* bind a symbol to a value, the value is moved into the environment
+ * rather than copied */
+void lenv_bind(lenv* le, lval* key, lval* value) {
+
+  /* let optimized code know one of its assumptions may be broken */
+  lopt_rebind(key);
+
+  /* iterate over all items in environment */
+  /* this is to see if variable already exists */
+  for (int i = 0; i < le->length; i++) {
+
+    /* if variable is found delete item at that position */
+    /* and replace with variable supplied by user */
+    if (strcmp(le->symbols[i], key->sym) == 0) {
+      lval_del(le->lvals[i]);
+      le->lvals[i] = value;
+      return;
+    }
+  }
+
+  /* if no existing entry found allocate space for new entry */
+  le->length++;
+  le->lvals = realloc(le->lvals, sizeof(lval*) * le->length);
+  le->symbols = realloc(le->symbols, sizeof(char*) * le->length);
+
+  /* store the value and copy the symbol string into new location */
+  le->lvals[le->length - 1] = value;
+  le->symbols[le->length - 1] = malloc(strlen(key->sym) + 1);
+  strcpy(le->symbols[le->length - 1], key->sym);
+}
+
 lenv* lenv_copy(lenv* le) {
   lenv* copy = malloc(sizeof(lenv));
 
@@ -44,16 +76,16 @@ void lenv_del(lenv* le) {
   free(le);
 }
 
-lval* lenv_get(lenv* le, lval* key) {
+/* find the value bound to a symbol without copying it, NULL if unbound */
+lval* lenv_find(lenv* le, lval* key) {
 
   do {
 
     /* iterate over all items in environment */
     for (int i = 0; i < le->length; i++) {
     /* check if the stored string matches the symbol string */
-    /* if it does, return a copy of the value */
       if (strcmp(le->symbols[i], key->sym) == 0) {
-        return lval_copy(le->lvals[i]);
+        return le->lvals[i];
       }
     }
 
@@ -61,6 +93,17 @@ lval* lenv_get(lenv* le, lval* key) {
   }
   while (le);
 
+  return NULL;
+}
+
+lval* lenv_get(lenv* le, lval* key) {
+  lval* lv = lenv_find(le, key);
+
+  /* if it is found, return a copy of the value */
+  if (lv) {
+    return lval_copy(lv);
+  }
+
   /* if no symbol found, check return error */
   return lval_err("Unbound Symbol '%s'", key->sym);
 }
@@ -76,27 +119,5 @@ lenv* lenv_new(void) {
 }
 
 void lenv_put(lenv* le, lval* key, lval* value) {
-
-  /* iterate over all items in environment */
-  /* this is to see if variable already exists */
-  for (int i = 0; i < le->length; i++) {
-
-    /* if variable is found delete item at that position */
-    /* and replace with variable supplied by user */
-    if (strcmp(le->symbols[i], key->sym) == 0) {
-      lval_del(le->lvals[i]);
-      le->lvals[i] = lval_copy(value);
-      return;
-    }
-  }
-
-  /* if no existing entry found allocate space for new entry */
-  le->length++;
-  le->lvals = realloc(le->lvals, sizeof(lval*) * le->length);
-  le->symbols = realloc(le->symbols, sizeof(char*) * le->length);
-
-  /* copy contents of lval and symbol string into new location */
-  le->lvals[le->length - 1] = lval_copy(value);
-  le->symbols[le->length - 1] = malloc(strlen(key->sym) + 1);
-  strcpy(le->symbols[le->length - 1], key->sym);
+  lenv_bind(le, key, lval_copy(value));
 }
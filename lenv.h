@@ -18,8 +18,10 @@ typedef struct lenv {
 lenv* lenv_copy(lenv*);
 lenv* lenv_new(void);
 
+struct lval* lenv_find(lenv*, struct lval*);
 struct lval* lenv_get(lenv* e, struct lval* k);
 
+void lenv_bind(lenv*, struct lval*, struct lval*);
 void lenv_def(lenv*, struct lval*, struct lval*);
 void lenv_del(lenv*);
 void lenv_put(lenv*, struct lval*, struct lval*);
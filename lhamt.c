@@ -0,0 +1,450 @@
+#include <stdlib.h>
+
+#include "lbuf.h"
+#include "lhamt.h"
+#include "lval.h"
+
+
+/* bit of a branch at shift selecting the child for a hash */
+static unsigned int lhamt_bit(unsigned long hash, int shift) {
+  return 1u << ((hash >> shift) & ((1 << LHAMT_BITS) - 1));
+}
+
+/* position of a child among those present in a branch */
+static int lhamt_index(unsigned int bitmap, unsigned int bit) {
+  return __builtin_popcount(bitmap & (bit - 1));
+}
+
+static lhamt_node* lhamt_node_new(int kind, int length) {
+  lhamt_node* node = malloc(sizeof(lhamt_node) + sizeof(lhamt_node*) * length);
+  node->refs = 1;
+  node->kind = kind;
+  node->hash = 0;
+  node->key = NULL;
+  node->value = NULL;
+  node->bitmap = 0;
+  node->length = length;
+  return node;
+}
+
+static lhamt_node* lhamt_leaf(unsigned long hash, lval* key, lval* value) {
+  lhamt_node* leaf = lhamt_node_new(LHAMT_LEAF, 0);
+  leaf->hash = hash;
+  leaf->key = key;
+  leaf->value = value;
+  return leaf;
+}
+
+static lhamt_node* lhamt_ref(lhamt_node* node) {
+  node->refs++;
+  return node;
+}
+
+static void lhamt_node_del(lhamt_node* node) {
+  if (--node->refs > 0) {
+    return;
+  }
+
+  if (node->kind == LHAMT_LEAF) {
+    lval_del(node->key);
+    lval_del(node->value);
+  }
+
+  for (int i = 0; i < node->length; i++) {
+    lhamt_node_del(node->children[i]);
+  }
+
+  free(node);
+}
+
+/* copy of a node sharing its children, with child i replaced by next, or
+ * left out when next is NULL */
+static lhamt_node* lhamt_replace(lhamt_node* node, int i, lhamt_node* next) {
+  lhamt_node* copy = lhamt_node_new(node->kind, node->length - !next);
+  copy->hash = node->hash;
+  copy->bitmap = node->bitmap;
+
+  for (int j = 0, k = 0; j < node->length; j++) {
+    if (j != i) {
+      copy->children[k++] = lhamt_ref(node->children[j]);
+    } else if (next) {
+      copy->children[k++] = next;
+    }
+  }
+
+  return copy;
+}
+
+/* copy of a node sharing its children, with child inserted at i */
+static lhamt_node* lhamt_insert(lhamt_node* node, int i, lhamt_node* child) {
+  lhamt_node* copy = lhamt_node_new(node->kind, node->length + 1);
+  copy->hash = node->hash;
+  copy->bitmap = node->bitmap;
+
+  for (int j = 0, k = 0; k < copy->length; k++) {
+    copy->children[k] = k == i ? child : lhamt_ref(node->children[j++]);
+  }
+
+  return copy;
+}
+
+/* branches holding two leaves or collisions with different hashes, nested
+ * until the bits of their hashes at shift differ. Takes both nodes */
+static lhamt_node* lhamt_merge(lhamt_node* a, lhamt_node* b, int shift) {
+  unsigned int bita = lhamt_bit(a->hash, shift);
+  unsigned int bitb = lhamt_bit(b->hash, shift);
+
+  if (bita == bitb) {
+    lhamt_node* node = lhamt_node_new(LHAMT_BRANCH, 1);
+    node->bitmap = bita;
+    node->children[0] = lhamt_merge(a, b, shift + LHAMT_BITS);
+    return node;
+  }
+
+  lhamt_node* node = lhamt_node_new(LHAMT_BRANCH, 2);
+  node->bitmap = bita | bitb;
+  node->children[bita < bitb ? 0 : 1] = a;
+  node->children[bita < bitb ? 1 : 0] = b;
+  return node;
+}
+
+/* node with leaf added below it, replacing any leaf with an equal key.
+ * Borrows node, which may be NULL, and takes leaf */
+static lhamt_node* lhamt_assoc(lhamt_node* node, int shift, lhamt_node* leaf,
+    int* added) {
+
+  if (!node) {
+    *added = 1;
+    return leaf;
+  }
+
+  switch (node->kind) {
+    case LHAMT_BRANCH: {
+      unsigned int bit = lhamt_bit(leaf->hash, shift);
+      int i = lhamt_index(node->bitmap, bit);
+
+      if (!(node->bitmap & bit)) {
+        lhamt_node* copy = lhamt_insert(node, i, leaf);
+        copy->bitmap |= bit;
+        *added = 1;
+        return copy;
+      }
+
+      lhamt_node* child = lhamt_assoc(node->children[i], shift + LHAMT_BITS,
+        leaf, added);
+
+      return lhamt_replace(node, i, child);
+    }
+
+    case LHAMT_LEAF:
+      if (node->hash != leaf->hash) {
+        *added = 1;
+        return lhamt_merge(lhamt_ref(node), leaf, shift);
+      }
+
+      if (lval_eq(node->key, leaf->key)) {
+        *added = 0;
+        return leaf;
+      }
+
+      /* different keys with the same hash share a collision node */
+      lhamt_node* collision = lhamt_node_new(LHAMT_COLLISION, 2);
+      collision->hash = leaf->hash;
+      collision->children[0] = lhamt_ref(node);
+      collision->children[1] = leaf;
+
+      *added = 1;
+      return collision;
+
+    case LHAMT_COLLISION:
+      if (node->hash != leaf->hash) {
+        *added = 1;
+        return lhamt_merge(lhamt_ref(node), leaf, shift);
+      }
+
+      for (int i = 0; i < node->length; i++) {
+        if (lval_eq(node->children[i]->key, leaf->key)) {
+          *added = 0;
+          return lhamt_replace(node, i, leaf);
+        }
+      }
+
+      *added = 1;
+      return lhamt_insert(node, node->length, leaf);
+  }
+
+  return NULL;
+}
+
+/* node without the leaf for key, NULL if nothing is left, or node itself
+ * when the key is not below it. Borrows node */
+static lhamt_node* lhamt_dissoc(lhamt_node* node, int shift, lval* key,
+    unsigned long hash) {
+
+  switch (node->kind) {
+    case LHAMT_BRANCH: {
+      unsigned int bit = lhamt_bit(hash, shift);
+      int i = lhamt_index(node->bitmap, bit);
+
+      if (!(node->bitmap & bit)) {
+        return lhamt_ref(node);
+      }
+
+      lhamt_node* child = node->children[i];
+      lhamt_node* next = lhamt_dissoc(child, shift + LHAMT_BITS, key, hash);
+
+      if (next == child) {
+        lhamt_node_del(next);
+        return lhamt_ref(node);
+      }
+
+      if (!next && node->length == 1) {
+        return NULL;
+      }
+
+      /* a branch left with a single leaf or collision is replaced by it,
+       * which keeps the trie no deeper than the keys need */
+      if (!next && node->length == 2 &&
+          node->children[1 - i]->kind != LHAMT_BRANCH) {
+        return lhamt_ref(node->children[1 - i]);
+      }
+
+      if (next && node->length == 1 && next->kind != LHAMT_BRANCH) {
+        return next;
+      }
+
+      lhamt_node* copy = lhamt_replace(node, i, next);
+
+      if (!next) {
+        copy->bitmap &= ~bit;
+      }
+
+      return copy;
+    }
+
+    case LHAMT_LEAF:
+      if (node->hash == hash && lval_eq(node->key, key)) {
+        return NULL;
+      }
+
+      return lhamt_ref(node);
+
+    case LHAMT_COLLISION:
+      if (node->hash != hash) {
+        return lhamt_ref(node);
+      }
+
+      for (int i = 0; i < node->length; i++) {
+        if (!lval_eq(node->children[i]->key, key)) {
+          continue;
+        }
+
+        if (node->length == 2) {
+          return lhamt_ref(node->children[1 - i]);
+        }
+
+        return lhamt_replace(node, i, NULL);
+      }
+
+      return lhamt_ref(node);
+  }
+
+  return NULL;
+}
+
+/* append the leaves below a node to leaves */
+static void lhamt_collect(lhamt_node* node, lhamt_node** leaves, long* length) {
+  if (node->kind == LHAMT_LEAF) {
+    leaves[(*length)++] = node;
+    return;
+  }
+
+  for (int i = 0; i < node->length; i++) {
+    lhamt_collect(node->children[i], leaves, length);
+  }
+}
+
+/* every leaf of a map in a new array of length elements */
+static lhamt_node** lhamt_leaves(lhamt* lh) {
+  lhamt_node** leaves = malloc(sizeof(lhamt_node*) * (lh->length ? lh->length : 1));
+  long length = 0;
+
+  if (lh->root) {
+    lhamt_collect(lh->root, leaves, &length);
+  }
+
+  return leaves;
+}
+
+
+/* release a reference to a version of a map */
+void lhamt_del(lhamt* lh) {
+  if (--lh->refs > 0) {
+    return;
+  }
+
+  if (lh->root) {
+    lhamt_node_del(lh->root);
+  }
+
+  free(lh);
+}
+
+/* maps are equal when they hold equal values under the same keys */
+int lhamt_eq(lhamt* x, lhamt* y) {
+  if (x->length != y->length) {
+    return 0;
+  }
+
+  /* versions that share their root are the same map */
+  if (x->root == y->root) {
+    return 1;
+  }
+
+  lhamt_node** leaves = lhamt_leaves(x);
+  int eq = 1;
+
+  for (long i = 0; i < x->length && eq; i++) {
+    lval* value = lhamt_get(y, leaves[i]->key);
+    eq = value && lval_eq(value, leaves[i]->value);
+  }
+
+  free(leaves);
+  return eq;
+}
+
+/* value stored under key, borrowed from the map, or NULL */
+lval* lhamt_get(lhamt* lh, lval* key) {
+  unsigned long hash = lval_hash(key);
+  lhamt_node* node = lh->root;
+
+  for (int shift = 0; node; shift += LHAMT_BITS) {
+    switch (node->kind) {
+      case LHAMT_BRANCH: {
+        unsigned int bit = lhamt_bit(hash, shift);
+
+        if (!(node->bitmap & bit)) {
+          return NULL;
+        }
+
+        node = node->children[lhamt_index(node->bitmap, bit)];
+        break;
+      }
+
+      case LHAMT_LEAF:
+        return node->hash == hash && lval_eq(node->key, key) ?
+          node->value : NULL;
+
+      case LHAMT_COLLISION:
+        for (int i = 0; i < node->length && node->hash == hash; i++) {
+          if (lval_eq(node->children[i]->key, key)) {
+            return node->children[i]->value;
+          }
+        }
+
+        return NULL;
+    }
+  }
+
+  return NULL;
+}
+
+/* hash independent of the order of the leaves, which differs between
+ * equal maps when keys collide */
+unsigned long lhamt_hash(lhamt* lh) {
+  lhamt_node** leaves = lhamt_leaves(lh);
+  unsigned long hash = lh->length;
+
+  for (long i = 0; i < lh->length; i++) {
+    hash += (leaves[i]->hash ^ lval_hash(leaves[i]->value)) * 1099511628211UL;
+  }
+
+  free(leaves);
+  return hash;
+}
+
+/* check if any key or value holds the vector or map y */
+int lhamt_holds(lhamt* lh, lval* y) {
+  lhamt_node** leaves = lhamt_leaves(lh);
+  int holds = 0;
+
+  for (long i = 0; i < lh->length && !holds; i++) {
+    holds = lval_contains(leaves[i]->key, y) ||
+            lval_contains(leaves[i]->value, y);
+  }
+
+  free(leaves);
+  return holds;
+}
+
+/* the keys as a Q-Expression, in no particular order */
+lval* lhamt_keys(lhamt* lh) {
+  lhamt_node** leaves = lhamt_leaves(lh);
+  lval* keys = lval_qexpr();
+  keys->cell = malloc(sizeof(lval*) * (lh->length ? lh->length : 1));
+
+  for (long i = 0; i < lh->length; i++) {
+    keys->cell[keys->length++] = lval_copy(leaves[i]->key);
+  }
+
+  free(leaves);
+  return keys;
+}
+
+lhamt* lhamt_new(void) {
+  lhamt* lh = malloc(sizeof(lhamt));
+  lh->refs = 1;
+  lh->length = 0;
+  lh->root = NULL;
+  return lh;
+}
+
+/* new version without key, or the same one when key is not in it */
+lhamt* lhamt_remove(lhamt* lh, lval* key) {
+  if (!lh->root) {
+    lh->refs++;
+    return lh;
+  }
+
+  lhamt_node* root = lhamt_dissoc(lh->root, 0, key, lval_hash(key));
+
+  if (root == lh->root) {
+    lhamt_node_del(root);
+    lh->refs++;
+    return lh;
+  }
+
+  lhamt* next = lhamt_new();
+  next->length = lh->length - 1;
+  next->root = root;
+  return next;
+}
+
+/* new version with value stored under key, taking ownership of both */
+lhamt* lhamt_set(lhamt* lh, lval* key, lval* value) {
+  int added;
+  lhamt_node* leaf = lhamt_leaf(lval_hash(key), key, value);
+
+  lhamt* next = lhamt_new();
+  next->root = lhamt_assoc(lh->root, 0, leaf, &added);
+  next->length = lh->length + added;
+  return next;
+}
+
+void lhamt_write(lbuf* lb, lhamt* lh) {
+  lhamt_node** leaves = lhamt_leaves(lh);
+  lbuf_str(lb, "#{");
+
+  for (long i = 0; i < lh->length; i++) {
+    if (i) {
+      lbuf_char(lb, ' ');
+    }
+
+    lval_write(lb, leaves[i]->key);
+    lbuf_char(lb, ' ');
+    lval_write(lb, leaves[i]->value);
+  }
+
+  lbuf_char(lb, '}');
+  free(leaves);
+}
@@ -0,0 +1,64 @@
+#ifndef LHAMT_H_
+#define LHAMT_H_
+
+#include "lval.h"
+
+
+/* bits of the hash consumed by each level of the trie */
+#define LHAMT_BITS 5
+
+/* kinds of trie node */
+enum {
+  LHAMT_BRANCH,
+  LHAMT_COLLISION,
+  LHAMT_LEAF,
+};
+
+/* node of a hash array mapped trie, immutable once built and shared
+ * between every version of a map that contains it. A branch has a child
+ * for each bit set in its bitmap, chosen by the next bits of the hash. A
+ * leaf holds one key, and a collision holds the leaves of keys whose
+ * hashes are equal */
+typedef struct lhamt_node {
+  int refs;
+  int kind;
+
+  /* leaf and collision, hash of the keys */
+  unsigned long hash;
+
+  /* leaf */
+  lval* key;
+  lval* value;
+
+  /* branch and collision */
+  unsigned int bitmap;
+  int length;
+  struct lhamt_node* children[];
+} lhamt_node;
+
+/* persistent map, a version of the trie. Updates build a new version that
+ * shares all but the path to the changed key with the old one */
+typedef struct lhamt {
+  int refs;
+
+  long length;
+  lhamt_node* root;
+} lhamt;
+
+
+int lhamt_eq(lhamt*, lhamt*);
+int lhamt_holds(lhamt*, lval*);
+
+lhamt* lhamt_new(void);
+lhamt* lhamt_remove(lhamt*, lval*);
+lhamt* lhamt_set(lhamt*, lval*, lval*);
+
+lval* lhamt_get(lhamt*, lval*);
+lval* lhamt_keys(lhamt*);
+
+unsigned long lhamt_hash(lhamt*);
+
+void lhamt_del(lhamt*);
+void lhamt_write(struct lbuf*, lhamt*);
+
+#endif
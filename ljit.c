@@ -0,0 +1,443 @@
+/* mmap and MAP_ANONYMOUS are not part of C99 */
+#define _DEFAULT_SOURCE
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "builtins.h"
+#include "lbuf.h"
+#include "ljit.h"
+#include "lspec.h"
+#include "lval.h"
+
+/* code is only generated for x86-64 with the System V calling convention */
+#if defined(__x86_64__) && !defined(_WIN32)
+#define LJIT_NATIVE
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+#ifndef MAP_ANONYMOUS
+#define MAP_ANONYMOUS MAP_ANON
+#endif
+
+
+#ifdef LJIT_NATIVE
+int ljit_on = 1;
+#else
+int ljit_on = 0;
+#endif
+
+/* machine code being emitted for a body. Failing checks jump to bail,
+ * recursive calls go to body and are counted in calls */
+typedef struct lemit {
+  lbuf lb;
+  int bail;
+  int body;
+  long* calls;
+} lemit;
+
+/* where the operand of an instruction is, see ljit_arith */
+enum {
+  LJIT_CONST,
+  LJIT_SLOT,
+  LJIT_STACK,
+};
+
+
+static void ljit_expr(lemit*, lspec*);
+
+
+static void ljit_bytes(lemit* le, char* bytes, int length) {
+  lbuf_write(&le->lb, bytes, length);
+}
+
+static void ljit_int(lemit* le, long value) {
+  for (int i = 0; i < 4; i++) {
+    lbuf_char(&le->lb, (char) (value >> (8 * i)));
+  }
+}
+
+static void ljit_long(lemit* le, long value) {
+  for (int i = 0; i < 8; i++) {
+    lbuf_char(&le->lb, (char) (value >> (8 * i)));
+  }
+}
+
+/* emit a 32 bit displacement to target, relative to the end of it */
+static void ljit_rel(lemit* le, int target) {
+  ljit_int(le, target - (le->lb.length + 4));
+}
+
+/* emit a displacement to be filled in by ljit_land, returns where it is */
+static int ljit_forward(lemit* le) {
+  int at = le->lb.length;
+  ljit_int(le, 0);
+  return at;
+}
+
+/* point a displacement emitted by ljit_forward at the current position */
+static void ljit_land(lemit* le, int at) {
+  int rel = le->lb.length - (at + 4);
+
+  for (int i = 0; i < 4; i++) {
+    le->lb.data[at + i] = (char) (rel >> (8 * i));
+  }
+}
+
+/* jo bail, after every instruction that can overflow */
+static void ljit_overflow(lemit* le) {
+  ljit_bytes(le, "\x0f\x80", 2);
+  ljit_rel(le, le->bail);
+}
+
+static int ljit_fits(long value) {
+  return value >= -2147483648L && value <= 2147483647L;
+}
+
+/* check if a node can be an operand of an instruction as it is */
+static int ljit_leaf(lspec* ls) {
+  return ls->kind == LSPEC_ARG ||
+    (ls->kind == LSPEC_NUM && ljit_fits(ls->num));
+}
+
+/* emit the addressing of an operand in memory after the opcode, with reg
+ * the register field of the ModRM byte */
+static void ljit_memory(lemit* le, int reg, int where, long offset) {
+  if (where == LJIT_SLOT) {
+    /* [rbx + disp32] */
+    lbuf_char(&le->lb, (char) (0x83 | reg << 3));
+  } else {
+    /* [rsp + disp32] */
+    lbuf_char(&le->lb, (char) (0x84 | reg << 3));
+    lbuf_char(&le->lb, 0x24);
+  }
+
+  ljit_int(le, offset);
+}
+
+/* rax = rax op operand for addition, subtraction, multiplication and
+ * comparison, where the operand is a constant, an argument slot or a
+ * value on the stack */
+static void ljit_arith(lemit* le, int op, int where, long value) {
+  if (where == LJIT_CONST) {
+    switch (op) {
+      case LOP_ADD: ljit_bytes(le, "\x48\x05", 2); break;
+      case LOP_SUB: ljit_bytes(le, "\x48\x2d", 2); break;
+      case LOP_MUL: ljit_bytes(le, "\x48\x69\xc0", 3); break;
+      default:      ljit_bytes(le, "\x48\x3d", 2); break;
+    }
+
+    ljit_int(le, value);
+    return;
+  }
+
+  switch (op) {
+    case LOP_ADD: ljit_bytes(le, "\x48\x03", 2); break;
+    case LOP_SUB: ljit_bytes(le, "\x48\x2b", 2); break;
+    case LOP_MUL: ljit_bytes(le, "\x48\x0f\xaf", 3); break;
+    default:      ljit_bytes(le, "\x48\x3b", 2); break;
+  }
+
+  ljit_memory(le, 0, where, where == LJIT_SLOT ? 8 * value : value);
+}
+
+/* rax = rax op the value of a leaf node */
+static void ljit_arith_leaf(lemit* le, int op, lspec* ls) {
+  if (ls->kind == LSPEC_ARG) {
+    ljit_arith(le, op, LJIT_SLOT, ls->num);
+  } else {
+    ljit_arith(le, op, LJIT_CONST, ls->num);
+  }
+}
+
+/* setcc al then movzx eax, al, turning the flags of a cmp into 0 or 1 */
+static void ljit_truth(lemit* le, int op) {
+  int set;
+
+  switch (op) {
+    case LOP_EQ: set = 0x94; break;
+    case LOP_NE: set = 0x95; break;
+    case LOP_LT: set = 0x9c; break;
+    case LOP_GE: set = 0x9d; break;
+    case LOP_LE: set = 0x9e; break;
+    default:     set = 0x9f; break;
+  }
+
+  ljit_bytes(le, "\x0f", 1);
+  lbuf_char(&le->lb, (char) set);
+  ljit_bytes(le, "\xc0\x0f\xb6\xc0", 4);
+}
+
+static int ljit_compare(int op) {
+  return op != LOP_ADD && op != LOP_SUB && op != LOP_MUL && op != LOP_DIV;
+}
+
+/* an operator applied to operands the fold reads in place, which covers
+ * most arithmetic in practice */
+static int ljit_op_leaves(lemit* le, lspec* ls) {
+  int n = ls->length;
+
+  if (ls->op == LOP_DIV ? n != 1 : ljit_compare(ls->op) && n != 2) {
+    return 0;
+  }
+
+  for (int i = 1; i < n; i++) {
+    if (!ljit_leaf(ls->cell[i])) {
+      return 0;
+    }
+  }
+
+  ljit_expr(le, ls->cell[0]);
+
+  if (ljit_compare(ls->op)) {
+    ljit_arith_leaf(le, ls->op, ls->cell[1]);
+    ljit_truth(le, ls->op);
+    return 1;
+  }
+
+  /* neg rax, a lone operand of subtraction is negated */
+  if (ls->op == LOP_SUB && n == 1) {
+    ljit_bytes(le, "\x48\xf7\xd8", 3);
+    ljit_overflow(le);
+  }
+
+  for (int i = 1; i < n; i++) {
+    ljit_arith_leaf(le, ls->op, ls->cell[i]);
+    ljit_overflow(le);
+  }
+
+  return 1;
+}
+
+/* an operator as lop_fold applies it. Every operand is evaluated and
+ * pushed first, operand i is then 8 * (n - 1 - i) bytes above rsp */
+static void ljit_op(lemit* le, lspec* ls) {
+  int n = ls->length;
+
+  if (ljit_op_leaves(le, ls)) {
+    return;
+  }
+
+  for (int i = 0; i < n; i++) {
+    ljit_expr(le, ls->cell[i]);
+    ljit_bytes(le, "\x50", 1);
+  }
+
+  switch (ls->op) {
+
+    case LOP_ADD:
+    case LOP_SUB:
+    case LOP_MUL:
+      /* mov rax, [rsp + x0] */
+      ljit_bytes(le, "\x48\x8b", 2);
+      ljit_memory(le, 0, LJIT_STACK, 8 * (n - 1));
+
+      if (ls->op == LOP_SUB && n == 1) {
+        ljit_bytes(le, "\x48\xf7\xd8", 3);
+        ljit_overflow(le);
+      }
+
+      for (int i = 1; i < n; i++) {
+        ljit_arith(le, ls->op, LJIT_STACK, 8 * (n - 1 - i));
+        ljit_overflow(le);
+      }
+      break;
+
+    case LOP_DIV:
+      ljit_bytes(le, "\x48\x8b", 2);
+      ljit_memory(le, 0, LJIT_STACK, 8 * (n - 1));
+
+      for (int i = 1; i < n; i++) {
+        /* mov rcx, [rsp + xi], test rcx, rcx, jz bail */
+        ljit_bytes(le, "\x48\x8b", 2);
+        ljit_memory(le, 1, LJIT_STACK, 8 * (n - 1 - i));
+        ljit_bytes(le, "\x48\x85\xc9\x0f\x84", 5);
+        ljit_rel(le, le->bail);
+
+        /* cmp rcx, -1, jne idiv. Dividing by -1 is a negation, which
+         * overflows where idiv would trap */
+        ljit_bytes(le, "\x48\x83\xf9\xff\x0f\x85", 6);
+        int divide = ljit_forward(le);
+        ljit_bytes(le, "\x48\xf7\xd8", 3);
+        ljit_overflow(le);
+        ljit_bytes(le, "\xe9", 1);
+        int next = ljit_forward(le);
+
+        /* cqo, idiv rcx */
+        ljit_land(le, divide);
+        ljit_bytes(le, "\x48\x99\x48\xf7\xf9", 5);
+        ljit_land(le, next);
+      }
+      break;
+
+    /* comparisons hold if they hold for every consecutive pair, edx
+     * holds the truth so far */
+    default:
+      ljit_bytes(le, "\xba\x01\x00\x00\x00", 5);
+
+      for (int i = 1; i < n; i++) {
+        ljit_bytes(le, "\x48\x8b", 2);
+        ljit_memory(le, 0, LJIT_STACK, 8 * (n - i));
+        ljit_arith(le, ls->op, LJIT_STACK, 8 * (n - 1 - i));
+        ljit_truth(le, ls->op);
+
+        /* and edx, eax */
+        ljit_bytes(le, "\x21\xc2", 2);
+      }
+
+      /* mov eax, edx */
+      ljit_bytes(le, "\x89\xd0", 2);
+      break;
+  }
+
+  /* add rsp, 8 * n */
+  ljit_bytes(le, "\x48\x81\xc4", 3);
+  ljit_int(le, 8 * n);
+}
+
+/* emit code leaving the value of a node in rax */
+static void ljit_expr(lemit* le, lspec* ls) {
+  switch (ls->kind) {
+
+    case LSPEC_NUM:
+      if (ljit_fits(ls->num)) {
+        ljit_bytes(le, "\x48\xc7\xc0", 3);
+        ljit_int(le, ls->num);
+      } else {
+        ljit_bytes(le, "\x48\xb8", 2);
+        ljit_long(le, ls->num);
+      }
+      break;
+
+    /* mov rax, [rbx + 8 * slot] */
+    case LSPEC_ARG:
+      ljit_bytes(le, "\x48\x8b", 2);
+      ljit_memory(le, 0, LJIT_SLOT, 8 * ls->num);
+      break;
+
+    case LSPEC_OP:
+      ljit_op(le, ls);
+      break;
+
+    case LSPEC_IF: {
+      /* test rax, rax, jz else */
+      ljit_expr(le, ls->cell[0]);
+      ljit_bytes(le, "\x48\x85\xc0\x0f\x84", 5);
+      int otherwise = ljit_forward(le);
+
+      ljit_expr(le, ls->cell[1]);
+      ljit_bytes(le, "\xe9", 1);
+      int end = ljit_forward(le);
+
+      ljit_land(le, otherwise);
+      ljit_expr(le, ls->cell[2]);
+      ljit_land(le, end);
+      break;
+    }
+
+    /* the arguments are stored below the stack pointer as the slots of
+     * the callee, rbx points at them for the duration of the call */
+    case LSPEC_SELF: {
+      int n = ls->length;
+
+      /* sub rsp, 8 * n */
+      ljit_bytes(le, "\x48\x81\xec", 3);
+      ljit_int(le, 8 * n);
+
+      for (int i = 0; i < n; i++) {
+        /* mov [rsp + 8 * i], rax */
+        ljit_expr(le, ls->cell[i]);
+        ljit_bytes(le, "\x48\x89", 2);
+        ljit_memory(le, 0, LJIT_STACK, 8 * i);
+      }
+
+      /* mov rcx, &calls, inc qword [rcx] */
+      ljit_bytes(le, "\x48\xb9", 2);
+      ljit_long(le, (long) le->calls);
+      ljit_bytes(le, "\x48\xff\x01", 3);
+
+      /* push rbx, lea rbx, [rsp + 8], call body, pop rbx */
+      ljit_bytes(le, "\x53\x48\x8d\x5c\x24\x08\xe8", 7);
+      ljit_rel(le, le->body);
+      ljit_bytes(le, "\x5b", 1);
+
+      ljit_bytes(le, "\x48\x81\xc4", 3);
+      ljit_int(le, 8 * n);
+      break;
+    }
+  }
+}
+
+
+int ljit_call(ljit* lj, long* slots, long* acc) {
+  return lj->code(slots, acc);
+}
+
+/* compile a specialized body of a lambda to machine code. Returns NULL
+ * where code cannot be generated or mapped executable */
+ljit* ljit_compile(lcode* lc, lspec* ls) {
+#ifdef LJIT_NATIVE
+  lemit le = {{0, 0, NULL}, 0, 0, &lc->calls};
+
+  /* push rbp, mov rbp, rsp, push rbx, push r12, push r13. The slots go in
+   * rbx and acc in r13, r12 keeps the stack pointer to bail out to */
+  ljit_bytes(&le, "\x55\x48\x89\xe5\x53\x41\x54\x41\x55", 9);
+  ljit_bytes(&le, "\x49\x89\xf5\x48\x89\xfb\x49\x89\xe4", 9);
+
+  /* call body, mov [r13], rax, mov eax, 1 */
+  ljit_bytes(&le, "\xe8", 1);
+  int call = ljit_forward(&le);
+  ljit_bytes(&le, "\x49\x89\x45\x00\xb8\x01\x00\x00\x00", 9);
+
+  /* pop r13, pop r12, pop rbx, pop rbp, ret */
+  int done = le.lb.length;
+  ljit_bytes(&le, "\x41\x5d\x41\x5c\x5b\x5d\xc3", 7);
+
+  /* failing checks unwind every recursive call at once, then return 0 as
+   * mov rsp, r12, xor eax, eax, jmp done */
+  le.bail = le.lb.length;
+  ljit_bytes(&le, "\x4c\x89\xe4\x31\xc0\xe9", 6);
+  ljit_rel(&le, done);
+
+  /* the body proper leaves its value in rax and returns */
+  le.body = le.lb.length;
+  ljit_land(&le, call);
+  ljit_expr(&le, ls);
+  ljit_bytes(&le, "\xc3", 1);
+
+  /* the pages are only made executable once they are no longer writable */
+  long page = sysconf(_SC_PAGESIZE);
+  size_t size = (le.lb.length + page - 1) / page * page;
+
+  void* code = mmap(NULL, size, PROT_READ | PROT_WRITE,
+    MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+  if (code == MAP_FAILED) {
+    free(le.lb.data);
+    return NULL;
+  }
+
+  memcpy(code, le.lb.data, le.lb.length);
+  free(le.lb.data);
+
+  if (mprotect(code, size, PROT_READ | PROT_EXEC) != 0) {
+    munmap(code, size);
+    return NULL;
+  }
+
+  ljit* lj = malloc(sizeof(ljit));
+  lj->size = size;
+  lj->code = (int (*)(long*, long*)) code;
+  return lj;
+#else
+  return NULL;
+#endif
+}
+
+void ljit_del(ljit* lj) {
+#ifdef LJIT_NATIVE
+  munmap((void*) lj->code, lj->size);
+#endif
+  free(lj);
+}
@@ -0,0 +1,27 @@
+#ifndef LJIT_H_
+#define LJIT_H_
+
+#include <stddef.h>
+
+#include "lspec.h"
+#include "lval.h"
+
+
+/* machine code of a body specialized to integers, in pages of its own.
+ * It runs on the argument slots and stores the result in acc, returning 0
+ * wherever the specialized body would fail */
+typedef struct ljit {
+  size_t size;
+  int (*code)(long*, long*);
+} ljit;
+
+/* set while integer bodies are compiled to machine code and run in it */
+extern int ljit_on;
+
+int ljit_call(ljit*, long*, long*);
+
+ljit* ljit_compile(lcode*, lspec*);
+
+void ljit_del(ljit*);
+
+#endif
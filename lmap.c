@@ -0,0 +1,218 @@
+#include <stdlib.h>
+
+#include "lbuf.h"
+#include "lmap.h"
+#include "lval.h"
+
+
+/* home slot of a hash. Multiplying by 2^64 over the golden ratio spreads
+ * keys that only differ in their high bits, such as multiples of a power
+ * of two, over the whole table */
+static long lmap_home(lmap* lm, unsigned long hash) {
+  return (hash * 11400714819323198485UL) >> lm->shift;
+}
+
+/* slot holding key, or the empty slot where it would go */
+static long lmap_find(lmap* lm, lval* key, unsigned long hash) {
+  long mask = lm->size - 1;
+
+  for (long i = lmap_home(lm, hash);; i = (i + 1) & mask) {
+    lmap_slot* slot = &lm->slots[i];
+
+    if (!slot->key || (slot->hash == hash && lval_eq(slot->key, key))) {
+      return i;
+    }
+  }
+}
+
+/* double the number of slots, moving every entry to its new place */
+static void lmap_grow(lmap* lm) {
+  lmap_slot* old = lm->slots;
+  long size = lm->size;
+
+  lm->size *= 2;
+  lm->shift--;
+  lm->slots = calloc(lm->size, sizeof(lmap_slot));
+
+  for (long i = 0; i < size; i++) {
+    if (!old[i].key) {
+      continue;
+    }
+
+    /* keys are distinct, so the first free slot is theirs */
+    long j = lmap_home(lm, old[i].hash);
+
+    while (lm->slots[j].key) {
+      j = (j + 1) & (lm->size - 1);
+    }
+
+    lm->slots[j] = old[i];
+  }
+
+  free(old);
+}
+
+
+/* release a reference to a map */
+void lmap_del(lmap* lm) {
+  if (--lm->refs > 0) {
+    return;
+  }
+
+  for (long i = 0; i < lm->size; i++) {
+    if (lm->slots[i].key) {
+      lval_del(lm->slots[i].key);
+      lval_del(lm->slots[i].value);
+    }
+  }
+
+  free(lm->slots);
+  free(lm);
+}
+
+/* maps are equal when they hold equal values under the same keys */
+int lmap_eq(lmap* x, lmap* y) {
+  if (x->length != y->length) {
+    return 0;
+  }
+
+  for (long i = 0; i < x->size; i++) {
+    lmap_slot* slot = &x->slots[i];
+
+    if (!slot->key) {
+      continue;
+    }
+
+    lval* value = lmap_get(y, slot->key);
+
+    if (!value || !lval_eq(value, slot->value)) {
+      return 0;
+    }
+  }
+
+  return 1;
+}
+
+/* value stored under key, borrowed from the map, or NULL */
+lval* lmap_get(lmap* lm, lval* key) {
+  unsigned long hash = lval_hash(key);
+  lmap_slot* slot = &lm->slots[lmap_find(lm, key, hash)];
+
+  return slot->key ? slot->value : NULL;
+}
+
+/* hash independent of the order of the slots, which differs between equal
+ * maps built in a different order */
+unsigned long lmap_hash(lmap* lm) {
+  unsigned long hash = lm->length;
+
+  for (long i = 0; i < lm->size; i++) {
+    lmap_slot* slot = &lm->slots[i];
+
+    if (slot->key) {
+      hash += (slot->hash ^ lval_hash(slot->value)) * 1099511628211UL;
+    }
+  }
+
+  return hash;
+}
+
+/* the keys as a Q-Expression, in no particular order */
+lval* lmap_keys(lmap* lm) {
+  lval* keys = lval_qexpr();
+  keys->cell = malloc(sizeof(lval*) * (lm->length ? lm->length : 1));
+
+  for (long i = 0; i < lm->size; i++) {
+    if (lm->slots[i].key) {
+      keys->cell[keys->length++] = lval_copy(lm->slots[i].key);
+    }
+  }
+
+  return keys;
+}
+
+lmap* lmap_new(void) {
+  lmap* lm = malloc(sizeof(lmap));
+  lm->refs = 1;
+  lm->length = 0;
+  lm->size = 8;
+  lm->shift = 64 - 3;
+  lm->slots = calloc(lm->size, sizeof(lmap_slot));
+  return lm;
+}
+
+/* remove key, 0 if it was not in the map. Later entries of the probe run
+ * shift back into the gap, so lookups never need tombstones */
+int lmap_remove(lmap* lm, lval* key) {
+  long mask = lm->size - 1;
+  long i = lmap_find(lm, key, lval_hash(key));
+
+  if (!lm->slots[i].key) {
+    return 0;
+  }
+
+  lval_del(lm->slots[i].key);
+  lval_del(lm->slots[i].value);
+  lm->length--;
+
+  for (long j = (i + 1) & mask; lm->slots[j].key; j = (j + 1) & mask) {
+    long home = lmap_home(lm, lm->slots[j].hash);
+
+    /* entries whose home is between the gap and them stay put */
+    if (i <= j ? (i < home && home <= j) : (i < home || home <= j)) {
+      continue;
+    }
+
+    lm->slots[i] = lm->slots[j];
+    i = j;
+  }
+
+  lm->slots[i].key = NULL;
+  lm->slots[i].value = NULL;
+  return 1;
+}
+
+/* store value under key, taking ownership of both */
+void lmap_set(lmap* lm, lval* key, lval* value) {
+  unsigned long hash = lval_hash(key);
+  long i = lmap_find(lm, key, hash);
+
+  if (lm->slots[i].key) {
+    lval_del(key);
+    lval_del(lm->slots[i].value);
+    lm->slots[i].value = value;
+    return;
+  }
+
+  if ((lm->length + 1) * 4 > lm->size * 3) {
+    lmap_grow(lm);
+    i = lmap_find(lm, key, hash);
+  }
+
+  lm->slots[i].hash = hash;
+  lm->slots[i].key = key;
+  lm->slots[i].value = value;
+  lm->length++;
+}
+
+void lmap_write(lbuf* lb, lmap* lm) {
+  lbuf_str(lb, "#{");
+
+  for (long i = 0, seen = 0; i < lm->size; i++) {
+    lmap_slot* slot = &lm->slots[i];
+
+    if (!slot->key) {
+      continue;
+    }
+
+    if (seen++) {
+      lbuf_char(lb, ' ');
+    }
+
+    lval_write(lb, slot->key);
+    lbuf_char(lb, ' ');
+    lval_write(lb, slot->value);
+  }
+
+  lbuf_char(lb, '}');
+}
@@ -0,0 +1,45 @@
+#ifndef LMAP_H_
+#define LMAP_H_
+
+#include "lval.h"
+
+
+/* a key and its value, empty when there is no key */
+typedef struct lmap_slot {
+  unsigned long hash;
+
+  lval* key;
+  lval* value;
+} lmap_slot;
+
+/* hash map with open addressing and linear probing, shared by reference
+ * between copies like vectors. Keys are hashed when stored, so a vector
+ * changed after it is used as a key is no longer found */
+typedef struct lmap {
+  int refs;
+
+  long length;
+
+  /* slots, a power of two at most three quarters full, indexed by the top
+   * bits of the scrambled hash */
+  long size;
+  int shift;
+  lmap_slot* slots;
+} lmap;
+
+
+int lmap_eq(lmap*, lmap*);
+int lmap_remove(lmap*, lval*);
+
+lmap* lmap_new(void);
+
+lval* lmap_get(lmap*, lval*);
+lval* lmap_keys(lmap*);
+
+unsigned long lmap_hash(lmap*);
+
+void lmap_del(lmap*);
+void lmap_set(lmap*, lval*, lval*);
+void lmap_write(struct lbuf*, lmap*);
+
+#endif
@@ -0,0 +1,154 @@
+#include <stdlib.h>
+
+#include "lenv.h"
+#include "lmemo.h"
+#include "lval.h"
+
+
+/* unlink an entry from the least recently used list */
+static void lmemo_unlink(lmemo* lm, lmemo_entry* entry) {
+  if (entry->newer) {
+    entry->newer->older = entry->older;
+  } else {
+    lm->newest = entry->older;
+  }
+
+  if (entry->older) {
+    entry->older->newer = entry->newer;
+  } else {
+    lm->oldest = entry->newer;
+  }
+}
+
+/* link an entry as the most recently used one */
+static void lmemo_touch(lmemo* lm, lmemo_entry* entry) {
+  entry->newer = NULL;
+  entry->older = lm->newest;
+
+  if (lm->newest) {
+    lm->newest->newer = entry;
+  } else {
+    lm->oldest = entry;
+  }
+
+  lm->newest = entry;
+}
+
+/* remove the least recently used entry */
+static void lmemo_evict(lmemo* lm) {
+  lmemo_entry* entry = lm->oldest;
+  lmemo_entry** link = &lm->table[entry->hash & (lm->size - 1)];
+
+  while (*link != entry) {
+    link = &(*link)->next;
+  }
+
+  *link = entry->next;
+  lmemo_unlink(lm, entry);
+
+  lval_del(entry->args);
+  lval_del(entry->value);
+  free(entry);
+
+  lm->length--;
+  lm->evictions++;
+}
+
+/* call a memoized function, answering from the cache when possible */
+lval* lmemo_call(lenv* le, lmemo* lm, lval* la) {
+  unsigned long hash = lval_hash(la);
+
+  for (lmemo_entry* entry = lm->table[hash & (lm->size - 1)]; entry;
+       entry = entry->next) {
+
+    if (entry->hash == hash && lval_eq(entry->args, la)) {
+      lmemo_unlink(lm, entry);
+      lmemo_touch(lm, entry);
+
+      lm->hits++;
+      lval_del(la);
+      return lval_copy(entry->value);
+    }
+  }
+
+  lm->misses++;
+
+  /* calling consumes the function and the arguments, so use copies */
+  lval* args = lval_copy(la);
+  lval* func = lval_copy(lm->func);
+  lval* value = lval_call(le, func, la);
+  lval_del(func);
+
+  /* errors are not cached, the call may succeed in another environment */
+  if (value->type == LVAL_ERR || lm->capacity == 0) {
+    lval_del(args);
+    return value;
+  }
+
+  if (lm->length == lm->capacity) {
+    lmemo_evict(lm);
+  }
+
+  lmemo_entry* entry = malloc(sizeof(lmemo_entry));
+  entry->hash = hash;
+  entry->args = args;
+  entry->value = lval_copy(value);
+
+  lmemo_entry** bucket = &lm->table[hash & (lm->size - 1)];
+  entry->next = *bucket;
+  *bucket = entry;
+
+  lmemo_touch(lm, entry);
+  lm->length++;
+
+  return value;
+}
+
+/* release a reference to a cache */
+void lmemo_del(lmemo* lm) {
+  if (--lm->refs > 0) {
+    return;
+  }
+
+  while (lm->oldest) {
+    lmemo_evict(lm);
+  }
+
+  lval_del(lm->func);
+  free(lm->table);
+  free(lm);
+}
+
+lmemo* lmemo_new(lval* func, int capacity) {
+  lmemo* lm = malloc(sizeof(lmemo));
+  lm->refs = 1;
+  lm->func = func;
+  lm->capacity = capacity;
+  lm->length = 0;
+
+  /* keep chains short when the cache is full */
+  lm->size = 16;
+
+  while (lm->size < capacity) {
+    lm->size *= 2;
+  }
+
+  lm->table = calloc(lm->size, sizeof(lmemo_entry*));
+  lm->newest = NULL;
+  lm->oldest = NULL;
+
+  lm->hits = 0;
+  lm->misses = 0;
+  lm->evictions = 0;
+  return lm;
+}
+
+/* hits, misses, evictions and size of a cache as a Q-Expression */
+lval* lmemo_stats(lmemo* lm) {
+  lval* lv = lval_qexpr();
+  lv = lval_add(lv, lval_num(lm->hits));
+  lv = lval_add(lv, lval_num(lm->misses));
+  lv = lval_add(lv, lval_num(lm->evictions));
+  lv = lval_add(lv, lval_num(lm->length));
+  return lv;
+}
@@ -0,0 +1,49 @@
+#ifndef LMEMO_H_
+#define LMEMO_H_
+
+#include "lenv.h"
+#include "lval.h"
+
+
+/* a cached result, chained in its bucket and in least recently used order */
+typedef struct lmemo_entry {
+  unsigned long hash;
+
+  lval* args;
+  lval* value;
+
+  struct lmemo_entry* next;
+  struct lmemo_entry* newer;
+  struct lmemo_entry* older;
+} lmemo_entry;
+
+/* cache of a memoized function, shared between all copies of it */
+typedef struct lmemo {
+  int refs;
+
+  lval* func;
+
+  int capacity;
+  int length;
+
+  /* buckets, a power of two */
+  int size;
+  lmemo_entry** table;
+
+  lmemo_entry* newest;
+  lmemo_entry* oldest;
+
+  long hits;
+  long misses;
+  long evictions;
+} lmemo;
+
+
+lmemo* lmemo_new(lval*, int);
+
+lval* lmemo_call(lenv*, lmemo*, lval*);
+lval* lmemo_stats(lmemo*);
+
+void lmemo_del(lmemo*);
+
+#endif
@@ -0,0 +1,474 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "builtins.h"
+#include "lenv.h"
+#include "lmap.h"
+#include "lopt.h"
+#include "lspec.h"
+#include "lval.h"
+
+
+long lopt_epoch = 0;
+lcode* lopt_running = NULL;
+
+/* symbols whose current binding optimized code was built against, as
+ * keys of a map so every binding checks them in constant time */
+static lmap* assumed = NULL;
+
+
+/* how deep calls are inlined into each other, and how big a callee may be */
+#define LOPT_INLINE_DEPTH 4
+#define LOPT_INLINE_SIZE 32
+
+
+static lval* lopt_expr(lenv*, lval*, lval*, int, int*);
+
+
+/* drop optimized bodies, calls still running one keep it alive. The
+ * integer body never binds anything, so none of its calls can be running */
+static void lopt_retire(lcode* lc) {
+  if (lc->spec) {
+    lspec_del(lc->spec);
+    lc->spec = NULL;
+  }
+
+  if (!lc->opt) {
+    return;
+  }
+
+  if (lc->active == 0) {
+    lval_del(lc->opt);
+  } else {
+    lc->retired = lval_add(lc->retired ? lc->retired : lval_qexpr(), lc->opt);
+  }
+
+  lc->opt = NULL;
+}
+
+/* check if an expression uses a builtin that binds symbols */
+static int lopt_binds(lenv* le, lval* lv) {
+
+  if (lv->type == LVAL_SYM) {
+    lval* func = lenv_find(le, lv);
+
+    return func && func->type == LVAL_FUNC && (
+      func->builtin == builtin_def ||
+      func->builtin == builtin_let ||
+      func->builtin == builtin_put);
+  }
+
+  if (lv->type == LVAL_SEXPR || lv->type == LVAL_QEXPR) {
+    for (int i = 0; i < lv->length; i++) {
+      if (lopt_binds(le, lv->cell[i])) {
+        return 1;
+      }
+    }
+  }
+
+  return 0;
+}
+
+/* check if a symbol is one of the formal arguments of a lambda */
+static int lopt_formal(lval* formals, char* sym) {
+  for (int i = 0; i < formals->length; i++) {
+    if (strcmp(formals->cell[i]->sym, sym) == 0) {
+      return 1;
+    }
+  }
+
+  return 0;
+}
+
+/* check an expression only applies arithmetic builtins, which are assumed */
+static int lopt_pure(lenv* le, lval* formals, lval* lv) {
+
+  /* Q-Expressions could be evaluated in an environment we cannot see */
+  if (lv->type == LVAL_QEXPR) {
+    return 0;
+  }
+
+  if (lv->type != LVAL_SEXPR) {
+    return 1;
+  }
+
+  if (lv->length > 1) {
+    lval* head = lv->cell[0];
+
+    if (head->type != LVAL_SYM || lopt_formal(formals, head->sym)) {
+      return 0;
+    }
+
+    lval* func = lenv_find(le, head);
+
+    if (!func || lop_code(func) == -1) {
+      return 0;
+    }
+
+    lopt_assume(head);
+  }
+
+  for (int i = lv->length > 1 ? 1 : 0; i < lv->length; i++) {
+    if (!lopt_pure(le, formals, lv->cell[i])) {
+      return 0;
+    }
+  }
+
+  return 1;
+}
+
+/* check if a frame between le and the global environment binds a symbol
+ * optimized code was built against */
+static int lopt_shadowed(lenv* le) {
+  if (!assumed) {
+    return 0;
+  }
+
+  for (; le->parent; le = le->parent) {
+    for (int i = 0; i < le->length; i++) {
+      lval key;
+      key.type = LVAL_SYM;
+      key.sym = le->symbols[i];
+
+      if (lmap_get(assumed, &key)) {
+        return 1;
+      }
+    }
+  }
+
+  return 0;
+}
+
+/* count the nodes of an expression */
+static int lopt_size(lval* lv) {
+  int size = 1;
+
+  if (lv->type == LVAL_SEXPR || lv->type == LVAL_QEXPR) {
+    for (int i = 0; i < lv->length; i++) {
+      size += lopt_size(lv->cell[i]);
+    }
+  }
+
+  return size;
+}
+
+/* replace formal arguments with the expressions a call passes for them */
+static lval* lopt_subst(lval* lv, lval* formals, lval* call) {
+
+  if (lv->type == LVAL_SYM) {
+    for (int i = 0; i < formals->length; i++) {
+      if (strcmp(formals->cell[i]->sym, lv->sym) == 0) {
+        lval_del(lv);
+        return lval_copy(call->cell[i + 1]);
+      }
+    }
+  }
+
+  if (lv->type == LVAL_SEXPR) {
+    for (int i = 0; i < lv->length; i++) {
+      lv->cell[i] = lopt_subst(lv->cell[i], formals, call);
+    }
+  }
+
+  return lv;
+}
+
+/* count the uses of a symbol in an expression */
+static int lopt_uses(lval* lv, char* sym) {
+
+  if (lv->type == LVAL_SYM) {
+    return strcmp(lv->sym, sym) == 0;
+  }
+
+  int uses = 0;
+
+  if (lv->type == LVAL_SEXPR) {
+    for (int i = 0; i < lv->length; i++) {
+      uses += lopt_uses(lv->cell[i], sym);
+    }
+  }
+
+  return uses;
+}
+
+/* inline a call to a small lambda, NULL if the callee does not qualify */
+static lval* lopt_inline(lenv* le, lval* formals, lval* func, lval* call,
+                         int depth) {
+
+  lval* params = func->code->formals;
+
+  /* variadic lambdas and those given too few arguments are called normally */
+  if (params->length != call->length - 1 || lopt_formal(params, "&")) {
+    return NULL;
+  }
+
+  /* optimize the callee first so calls it makes get inlined too. As scope
+   * is dynamic the arguments of the caller shadow globals in it as well,
+   * and it starts from the source as its own optimized body may already
+   * have inlined one of them */
+  int changed = 0;
+  lval* scope = lval_join(lval_copy(params), lval_copy(formals));
+
+  lval* expr = lval_copy(func->code->body);
+  expr->type = LVAL_SEXPR;
+  expr = lopt_expr(le, scope, expr, depth + 1, &changed);
+
+  /* only arithmetic is left, which also rules out recursion, and its
+   * builtins must resolve the same in the caller and callee */
+  int pure = lopt_pure(le, scope, expr);
+  lval_del(scope);
+
+  if (!pure || lopt_size(expr) > LOPT_INLINE_SIZE) {
+    lval_del(expr);
+    return NULL;
+  }
+
+  for (int i = 0; i < params->length; i++) {
+    lval* arg = call->cell[i + 1];
+    int uses = lopt_uses(expr, params->cell[i]->sym);
+
+    /* constants and symbols can be repeated, other arguments must be pure
+     * and evaluated exactly once. Only constants may be dropped */
+    int atom = arg->type == LVAL_NUM || arg->type == LVAL_SYM;
+
+    if ((uses == 0 && arg->type != LVAL_NUM) ||
+        (uses > 1 && !atom) ||
+        (!atom && !lopt_pure(le, formals, arg))) {
+      lval_del(expr);
+      return NULL;
+    }
+  }
+
+  return lopt_subst(expr, params, call);
+}
+
+/* fold constants and inline small lambdas inside an expression */
+static lval* lopt_expr(lenv* le, lval* formals, lval* lv, int depth,
+                       int* changed) {
+
+  /* Q-Expressions are data and are left untouched */
+  if (lv->type != LVAL_SEXPR) {
+    return lv;
+  }
+
+  for (int i = 0; i < lv->length; i++) {
+    lv->cell[i] = lopt_expr(le, formals, lv->cell[i], depth, changed);
+  }
+
+  /* only calls through a symbol can be optimized */
+  if (lv->length < 2 || lv->cell[0]->type != LVAL_SYM) {
+    return lv;
+  }
+
+  /* arguments shadow globals when the body is evaluated */
+  lval* head = lv->cell[0];
+
+  if (lopt_formal(formals, head->sym)) {
+    return lv;
+  }
+
+  lval* func = lenv_find(le, head);
+
+  if (!func || func->type != LVAL_FUNC || func->memo || func->partial) {
+    return lv;
+  }
+
+  /* replace calls to small lambdas with their body */
+  if (!func->builtin) {
+
+    if (depth >= LOPT_INLINE_DEPTH) {
+      return lv;
+    }
+
+    lval* expr = lopt_inline(le, formals, func, lv, depth);
+
+    if (!expr) {
+      return lv;
+    }
+
+    /* the body is only valid for as long as the lambda stays bound */
+    lopt_assume(head);
+    (*changed)++;
+
+    lval_del(lv);
+
+    /* constant arguments may now make the inlined body foldable */
+    return lopt_expr(le, formals, expr, depth, changed);
+  }
+
+  if (lop_code(func) == -1) {
+    return lv;
+  }
+
+  for (int i = 1; i < lv->length; i++) {
+    if (lv->cell[i]->type != LVAL_NUM) {
+      return lv;
+    }
+  }
+
+  /* compute the result now, errors are left to happen at run time */
+  lval* args = lval_sexpr();
+
+  for (int i = 1; i < lv->length; i++) {
+    lval_add(args, lval_copy(lv->cell[i]));
+  }
+
+  lval* result = builtin_op(le, args, lop_code(func));
+
+  if (result->type != LVAL_NUM) {
+    lval_del(result);
+    return lv;
+  }
+
+  /* the result is only valid for as long as the builtin stays bound */
+  lopt_assume(head);
+  (*changed)++;
+
+  lval_del(lv);
+  return result;
+}
+
+void lopt_assume(lval* sym) {
+  if (!assumed) {
+    assumed = lmap_new();
+  }
+
+  if (!lmap_get(assumed, sym)) {
+    lmap_set(assumed, lval_copy(sym), lval_sexpr());
+  }
+}
+
+/* count a call and pick the body it runs. Bodies start in the
+ * tree-walker, are optimized once they get hot and fall back to it when a
+ * binding they were optimized against changes */
+lval* lopt_enter(lenv* le, lcode* lc) {
+  lc->calls++;
+
+  if (lc->tier != LTIER_BASE && lc->epoch != lopt_epoch) {
+    lopt_retire(lc);
+    lc->tier = LTIER_BASE;
+    lc->heat = 0;
+    lc->deopts++;
+  }
+
+  /* an argument that is not a number failed the guard of the integer
+   * body, so it is dropped for good */
+  if (lc->tier == LTIER_SPEC && lc->types != 1 << LVAL_NUM) {
+    lspec_del(lc->spec);
+    lc->spec = NULL;
+    lc->tier = LTIER_OPT;
+    lc->deopts++;
+  }
+
+  if (lc->tier == LTIER_BASE && ++lc->heat >= LOPT_HOT) {
+
+    /* scope is dynamic, so the body is optimized against the global
+     * bindings rather than those of whichever caller made it hot */
+    lenv* root = le;
+
+    while (root->parent) {
+      root = root->parent;
+    }
+
+    lc->opt = lopt_optimize(root, lc->formals, lc->body);
+    lc->tier = LTIER_OPT;
+
+    /* bodies only ever called with integers get an unboxed version */
+    if (lc->types == 1 << LVAL_NUM) {
+      lc->spec = lspec_compile(root, lc);
+      lc->tier = lc->spec ? LTIER_SPEC : LTIER_OPT;
+    }
+
+    lc->epoch = lopt_epoch;
+    lc->promotions++;
+
+    /* a caller binding a symbol the new code relies on shadows it for this
+     * call, so the body waits for another round of calls to be promoted */
+    if (lopt_shadowed(le)) {
+      lopt_retire(lc);
+      lc->tier = LTIER_BASE;
+      lc->heat = 0;
+      lc->promotions--;
+    }
+  }
+
+  /* no call is running an old body any more */
+  if (lc->active == 0 && lc->retired) {
+    lval_del(lc->retired);
+    lc->retired = NULL;
+  }
+
+  lc->active++;
+  lopt_running = lc;
+
+  return lc->opt ? lc->opt : lc->body;
+}
+
+void lopt_leave(lcode* lc, lcode* caller) {
+  lc->active--;
+  lopt_running = caller;
+}
+
+/* count an iteration of a loop towards the hotness of the running body */
+void lopt_loop(void) {
+  if (lopt_running) {
+    lopt_running->loops++;
+    lopt_running->heat++;
+  }
+}
+
+/* return an optimized copy of a lambda body, NULL if nothing changed */
+lval* lopt_optimize(lenv* le, lval* formals, lval* body) {
+
+  /* bindings made while the body runs are not seen by code optimized
+   * before it started, so such bodies are left alone */
+  if (lopt_binds(le, body)) {
+    return NULL;
+  }
+
+  int changed = 0;
+
+  /* the body itself is evaluated as an S-Expression */
+  lval* opt = lval_copy(body);
+  opt->type = LVAL_SEXPR;
+  opt = lopt_expr(le, formals, opt, 0, &changed);
+
+  if (!changed) {
+    lval_del(opt);
+    return NULL;
+  }
+
+  /* a body folded down to a single value becomes a single element list */
+  if (opt->type != LVAL_SEXPR) {
+    opt = lval_add(lval_sexpr(), opt);
+  }
+
+  opt->type = LVAL_QEXPR;
+  return opt;
+}
+
+/* invalidate optimized code when a symbol it relies on is bound again.
+ * As scope is dynamic this includes arguments named after it, which
+ * shadow it for every call made while they are bound */
+void lopt_rebind(lval* sym) {
+  if (!assumed || assumed->length == 0 || !lmap_get(assumed, sym)) {
+    return;
+  }
+
+  lopt_epoch++;
+
+  /* code optimized from now on registers its own assumptions */
+  lmap_del(assumed);
+  assumed = NULL;
+}
+
+/* tier, calls, loop iterations, promotions and deoptimizations of a body */
+lval* lopt_tier_stats(lcode* lc) {
+  lval* stats = lval_qexpr();
+  stats = lval_add(stats, lval_num(lc->tier));
+  stats = lval_add(stats, lval_num(lc->calls));
+  stats = lval_add(stats, lval_num(lc->loops));
+  stats = lval_add(stats, lval_num(lc->promotions));
+  stats = lval_add(stats, lval_num(lc->deopts));
+  return stats;
+}
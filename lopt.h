@@ -0,0 +1,33 @@
+#ifndef LOPT_H_
+#define LOPT_H_
+
+#include "lenv.h"
+#include "lval.h"
+
+
+/* tiers a lambda body runs in */
+enum {
+  LTIER_BASE,
+  LTIER_OPT,
+  LTIER_SPEC,
+};
+
+/* calls plus loop iterations before a body is optimized */
+#define LOPT_HOT 64
+
+/* bumped whenever a binding that optimized code relies on changes */
+extern long lopt_epoch;
+
+/* body of the innermost lambda call, NULL at the top level */
+extern lcode* lopt_running;
+
+lval* lopt_enter(lenv*, lcode*);
+lval* lopt_optimize(lenv*, lval*, lval*);
+lval* lopt_tier_stats(lcode*);
+
+void lopt_assume(lval*);
+void lopt_leave(lcode*, lcode*);
+void lopt_loop(void);
+void lopt_rebind(lval*);
+
+#endif
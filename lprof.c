@@ -0,0 +1,136 @@
+#include <string.h>
+
+#include "builtins.h"
+#include "lenv.h"
+#include "lprof.h"
+#include "lval.h"
+
+
+int lprof_on = 0;
+
+/* how often a node of one kind evaluated a child of another kind */
+static long lprof_pairs[LNODE_COUNT][LNODE_COUNT];
+
+static char* lprof_names[LNODE_COUNT] = {
+  [LNODE_ARITH]   = "arith",
+  [LNODE_CALL]    = "call",
+  [LNODE_COMPARE] = "compare",
+  [LNODE_COND]    = "cond",
+  [LNODE_IF]      = "if",
+  [LNODE_LET]     = "let",
+  [LNODE_LIST]    = "list",
+  [LNODE_NUM]     = "num",
+  [LNODE_SYM]     = "sym",
+  [LNODE_WHILE]   = "while",
+};
+
+
+/* kind of an expression, Q-Expressions are classified by the code they
+ * hold as that is how special forms run them */
+int lprof_kind(lenv* le, lval* lv) {
+
+  switch (lv->type) {
+    case LVAL_BIG:
+    case LVAL_FLOAT:
+    case LVAL_NUM:
+      return LNODE_NUM;
+
+    case LVAL_SYM:
+      return LNODE_SYM;
+
+    case LVAL_SEXPR:
+    case LVAL_QEXPR:
+      break;
+
+    default:
+      return LNODE_LIST;
+  }
+
+  /* a single expression evaluates to its only element */
+  if (lv->length == 1) {
+    return lprof_kind(le, lv->cell[0]);
+  }
+
+  if (lv->length == 0 || lv->cell[0]->type != LVAL_SYM) {
+    return LNODE_LIST;
+  }
+
+  lval* func = lenv_find(le, lv->cell[0]);
+
+  if (!func || func->type != LVAL_FUNC) {
+    return LNODE_LIST;
+  }
+
+  switch (lop_code(func)) {
+    case LOP_ADD:
+    case LOP_DIV:
+    case LOP_MUL:
+    case LOP_SUB:
+      return LNODE_ARITH;
+
+    case -1:
+      break;
+
+    default:
+      return LNODE_COMPARE;
+  }
+
+  if (func->builtin == builtin_cond)  { return LNODE_COND; }
+  if (func->builtin == builtin_if)    { return LNODE_IF; }
+  if (func->builtin == builtin_let)   { return LNODE_LET; }
+  if (func->builtin == builtin_while) { return LNODE_WHILE; }
+
+  return LNODE_CALL;
+}
+
+/* count the pairs an S-Expression forms with each of its arguments */
+void lprof_node(lenv* le, lval* lv) {
+  int parent = lprof_kind(le, lv);
+
+  for (int i = 1; i < lv->length; i++) {
+    lprof_pairs[parent][lprof_kind(le, lv->cell[i])]++;
+  }
+}
+
+void lprof_reset(void) {
+  memset(lprof_pairs, 0, sizeof(lprof_pairs));
+}
+
+/* the most frequent pairs, most frequent first, as {parent child count}.
+ * these are the candidates for fused evaluation paths */
+lval* lprof_table(int limit) {
+  lval* table = lval_qexpr();
+  int taken[LNODE_COUNT][LNODE_COUNT] = {{0}};
+
+  for (int n = 0; n < limit; n++) {
+    int parent = -1;
+    int child = -1;
+
+    for (int i = 0; i < LNODE_COUNT; i++) {
+      for (int j = 0; j < LNODE_COUNT; j++) {
+        if (taken[i][j] || lprof_pairs[i][j] == 0) {
+          continue;
+        }
+
+        if (parent == -1 || lprof_pairs[i][j] > lprof_pairs[parent][child]) {
+          parent = i;
+          child = j;
+        }
+      }
+    }
+
+    if (parent == -1) {
+      break;
+    }
+
+    taken[parent][child] = 1;
+
+    lval* row = lval_qexpr();
+    row = lval_add(row, lval_sym(lprof_names[parent]));
+    row = lval_add(row, lval_sym(lprof_names[child]));
+    row = lval_add(row, lval_num(lprof_pairs[parent][child]));
+    table = lval_add(table, row);
+  }
+
+  return table;
+}
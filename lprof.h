@@ -0,0 +1,33 @@
+#ifndef LPROF_H_
+#define LPROF_H_
+
+#include "lenv.h"
+#include "lval.h"
+
+
+/* kinds of expression nodes, as seen by the evaluator */
+enum {
+  LNODE_ARITH,
+  LNODE_CALL,
+  LNODE_COMPARE,
+  LNODE_COND,
+  LNODE_IF,
+  LNODE_LET,
+  LNODE_LIST,
+  LNODE_NUM,
+  LNODE_SYM,
+  LNODE_WHILE,
+  LNODE_COUNT,
+};
+
+/* set while node pairs are being counted */
+extern int lprof_on;
+
+int lprof_kind(lenv*, lval*);
+
+lval* lprof_table(int);
+
+void lprof_node(lenv*, lval*);
+void lprof_reset(void);
+
+#endif
@@ -0,0 +1,341 @@
+#include <stdlib.h>
+
+#include "lbuf.h"
+#include "lrope.h"
+#include "lval.h"
+
+
+static lrope* lrope_ref(lrope* lr) {
+  lr->refs++;
+  return lr;
+}
+
+/* leaf taking ownership of length elements */
+static lrope* lrope_leaf(lval** cells, long length) {
+  lrope* leaf = malloc(sizeof(lrope) + sizeof(lval*) * length);
+  leaf->refs = 1;
+  leaf->height = 0;
+  leaf->length = length;
+  leaf->left = NULL;
+  leaf->right = NULL;
+
+  for (long i = 0; i < length; i++) {
+    leaf->cells[i] = cells[i];
+  }
+
+  return leaf;
+}
+
+/* leaf with copies of the elements from up to to of another */
+static lrope* lrope_leaf_copy(lrope* leaf, long from, long to) {
+  lrope* copy = lrope_leaf(leaf->cells + from, to - from);
+
+  for (long i = 0; i < copy->length; i++) {
+    copy->cells[i] = lval_copy(copy->cells[i]);
+  }
+
+  return copy;
+}
+
+/* branch over two balanced trees, taking both */
+static lrope* lrope_pair(lrope* left, lrope* right) {
+  lrope* lr = malloc(sizeof(lrope));
+  lr->refs = 1;
+  lr->height = 1 + (left->height > right->height ? left->height : right->height);
+  lr->length = left->length + right->length;
+  lr->left = left;
+  lr->right = right;
+  return lr;
+}
+
+/* branch over two trees whose heights differ by up to two, rotated back
+ * into balance the way an AVL tree is. Takes both */
+static lrope* lrope_balance(lrope* left, lrope* right) {
+  if (left->height > right->height + 1) {
+    lrope* a = lrope_ref(left->left);
+    lrope* b = lrope_ref(left->right);
+    lrope_del(left);
+
+    if (a->height >= b->height) {
+      return lrope_pair(a, lrope_pair(b, right));
+    }
+
+    lrope* c = lrope_ref(b->left);
+    lrope* d = lrope_ref(b->right);
+    lrope_del(b);
+
+    return lrope_pair(lrope_pair(a, c), lrope_pair(d, right));
+  }
+
+  if (right->height > left->height + 1) {
+    lrope* a = lrope_ref(right->left);
+    lrope* b = lrope_ref(right->right);
+    lrope_del(right);
+
+    if (b->height >= a->height) {
+      return lrope_pair(lrope_pair(left, a), b);
+    }
+
+    lrope* c = lrope_ref(a->left);
+    lrope* d = lrope_ref(a->right);
+    lrope_del(a);
+
+    return lrope_pair(lrope_pair(left, c), lrope_pair(d, b));
+  }
+
+  return lrope_pair(left, right);
+}
+
+/* split off the first i elements into left and the rest into right,
+ * either of which may be empty. Takes lr */
+static void lrope_split(lrope* lr, long i, lrope** left, lrope** right) {
+  if (i == 0 || i == lr->length) {
+    *left = i ? lr : NULL;
+    *right = i ? NULL : lr;
+    return;
+  }
+
+  if (lr->height == 0) {
+    *left = lrope_leaf_copy(lr, 0, i);
+    *right = lrope_leaf_copy(lr, i, lr->length);
+    lrope_del(lr);
+    return;
+  }
+
+  lrope* a = lrope_ref(lr->left);
+  lrope* b = lrope_ref(lr->right);
+  lrope_del(lr);
+
+  if (i <= a->length) {
+    lrope* rest;
+    lrope_split(a, i, left, &rest);
+    *right = lrope_join(rest, b);
+  } else {
+    lrope* rest;
+    lrope_split(b, i - a->length, &rest, right);
+    *left = lrope_join(a, rest);
+  }
+}
+
+/* append the elements below a node to cells, borrowing them */
+static void lrope_collect(lrope* lr, lval** cells, long* length) {
+  if (lr->height > 0) {
+    lrope_collect(lr->left, cells, length);
+    lrope_collect(lr->right, cells, length);
+    return;
+  }
+
+  for (long i = 0; i < lr->length; i++) {
+    cells[(*length)++] = lr->cells[i];
+  }
+}
+
+/* every element in order in a new array */
+static lval** lrope_cells(lrope* lr) {
+  long length = 0;
+  lval** cells = malloc(sizeof(lval*) * (lr ? lr->length : 1));
+
+  if (lr) {
+    lrope_collect(lr, cells, &length);
+  }
+
+  return cells;
+}
+
+/* balanced tree over the leaves from up to to */
+static lrope* lrope_build(lrope** leaves, long from, long to) {
+  if (to - from == 1) {
+    return leaves[from];
+  }
+
+  long mid = from + (to - from) / 2;
+  return lrope_pair(lrope_build(leaves, from, mid),
+                    lrope_build(leaves, mid, to));
+}
+
+
+/* release a reference to a node */
+void lrope_del(lrope* lr) {
+  if (!lr || --lr->refs > 0) {
+    return;
+  }
+
+  if (lr->height > 0) {
+    lrope_del(lr->left);
+    lrope_del(lr->right);
+  } else {
+    for (long i = 0; i < lr->length; i++) {
+      lval_del(lr->cells[i]);
+    }
+  }
+
+  free(lr);
+}
+
+int lrope_eq(lrope* x, lrope* y) {
+  if (lrope_length(x) != lrope_length(y)) {
+    return 0;
+  }
+
+  if (x == y) {
+    return 1;
+  }
+
+  lval** a = lrope_cells(x);
+  lval** b = lrope_cells(y);
+  int eq = 1;
+
+  for (long i = 0; i < x->length && eq; i++) {
+    eq = lval_eq(a[i], b[i]);
+  }
+
+  free(a);
+  free(b);
+  return eq;
+}
+
+/* element i, borrowed from the vector */
+lval* lrope_get(lrope* lr, long i) {
+  while (lr->height > 0) {
+    if (i < lr->left->length) {
+      lr = lr->left;
+    } else {
+      i -= lr->left->length;
+      lr = lr->right;
+    }
+  }
+
+  return lr->cells[i];
+}
+
+/* hash of the elements in order, whatever the shape of the tree */
+unsigned long lrope_hash(lrope* lr) {
+  lval** cells = lrope_cells(lr);
+  unsigned long hash = lrope_length(lr);
+
+  for (long i = 0; i < lrope_length(lr); i++) {
+    hash = (hash ^ lval_hash(cells[i])) * 1099511628211UL;
+  }
+
+  free(cells);
+  return hash;
+}
+
+/* check if any element holds the vector or map y */
+int lrope_holds(lrope* lr, lval* y) {
+  lval** cells = lrope_cells(lr);
+  int holds = 0;
+
+  for (long i = 0; i < lrope_length(lr) && !holds; i++) {
+    holds = lval_contains(cells[i], y);
+  }
+
+  free(cells);
+  return holds;
+}
+
+/* concatenation sharing the nodes of both, taking both. Takes time in
+ * the difference of their heights, and fills the leaf at the seam when
+ * either side is a single leaf, so appending one element at a time still
+ * makes full leaves */
+lrope* lrope_join(lrope* x, lrope* y) {
+  if (!x || !y) {
+    return x ? x : y;
+  }
+
+  if (x->height == 0 && y->height == 0) {
+    if (x->length + y->length > LROPE_CHUNK) {
+      return lrope_pair(x, y);
+    }
+
+    lrope* leaf = lrope_leaf_copy(x, 0, x->length);
+    leaf = realloc(leaf, sizeof(lrope) + sizeof(lval*) * (x->length + y->length));
+
+    for (long i = 0; i < y->length; i++) {
+      leaf->cells[leaf->length++] = lval_copy(y->cells[i]);
+    }
+
+    lrope_del(x);
+    lrope_del(y);
+    return leaf;
+  }
+
+  if (x->height > y->height + 1 || (y->height == 0 && x->height > 0)) {
+    lrope* a = lrope_ref(x->left);
+    lrope* b = lrope_join(lrope_ref(x->right), y);
+    lrope_del(x);
+    return lrope_balance(a, b);
+  }
+
+  if (y->height > x->height + 1 || x->height == 0) {
+    lrope* a = lrope_join(x, lrope_ref(y->left));
+    lrope* b = lrope_ref(y->right);
+    lrope_del(y);
+    return lrope_balance(a, b);
+  }
+
+  return lrope_pair(x, y);
+}
+
+long lrope_length(lrope* lr) {
+  return lr ? lr->length : 0;
+}
+
+/* vector of length elements, taking ownership of them */
+lrope* lrope_new(lval** cells, long length) {
+  if (length == 0) {
+    return NULL;
+  }
+
+  long count = (length + LROPE_CHUNK - 1) / LROPE_CHUNK;
+  lrope** leaves = malloc(sizeof(lrope*) * count);
+
+  for (long i = 0; i < count; i++) {
+    long from = i * LROPE_CHUNK;
+    long to = from + LROPE_CHUNK < length ? from + LROPE_CHUNK : length;
+    leaves[i] = lrope_leaf(cells + from, to - from);
+  }
+
+  lrope* lr = lrope_build(leaves, 0, count);
+  free(leaves);
+  return lr;
+}
+
+/* elements from up to but not including to, sharing all but the leaves at
+ * either end with lr, which is borrowed */
+lrope* lrope_slice(lrope* lr, long from, long to) {
+  lrope* head;
+  lrope* rest;
+  lrope* tail;
+
+  if (!lr) {
+    return NULL;
+  }
+
+  lrope_split(lrope_ref(lr), to, &rest, &tail);
+  lrope_del(tail);
+
+  if (!rest) {
+    return NULL;
+  }
+
+  lrope_split(rest, from, &head, &rest);
+  lrope_del(head);
+  return rest;
+}
+
+void lrope_write(lbuf* lb, lrope* lr) {
+  lval** cells = lrope_cells(lr);
+  lbuf_str(lb, "#[");
+
+  for (long i = 0; i < lrope_length(lr); i++) {
+    if (i) {
+      lbuf_char(lb, ' ');
+    }
+
+    lval_write(lb, cells[i]);
+  }
+
+  lbuf_char(lb, ']');
+  free(cells);
+}
@@ -0,0 +1,46 @@
+#ifndef LROPE_H_
+#define LROPE_H_
+
+#include "lval.h"
+
+
+/* most elements held by a leaf */
+#define LROPE_CHUNK 32
+
+/* persistent vector as a height balanced tree of leaves holding up to
+ * LROPE_CHUNK elements each. Nodes are immutable and shared between every
+ * version that contains them, and the empty vector is NULL. A branch has
+ * both a left and a right child whose heights differ by at most one */
+typedef struct lrope {
+  int refs;
+  int height;
+
+  /* elements below the node */
+  long length;
+
+  /* branch */
+  struct lrope* left;
+  struct lrope* right;
+
+  /* leaf, length elements */
+  lval* cells[];
+} lrope;
+
+
+int lrope_eq(lrope*, lrope*);
+int lrope_holds(lrope*, lval*);
+
+lrope* lrope_join(lrope*, lrope*);
+lrope* lrope_new(lval**, long);
+lrope* lrope_slice(lrope*, long, long);
+
+lval* lrope_get(lrope*, long);
+
+long lrope_length(lrope*);
+
+unsigned long lrope_hash(lrope*);
+
+void lrope_del(lrope*);
+void lrope_write(struct lbuf*, lrope*);
+
+#endif
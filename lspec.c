@@ -0,0 +1,266 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "builtins.h"
+#include "lenv.h"
+#include "ljit.h"
+#include "lopt.h"
+#include "lspec.h"
+#include "lval.h"
+
+
+static lspec* lspec_code(lenv*, lcode*, lval*);
+static lspec* lspec_expr(lenv*, lcode*, lval*);
+
+
+static lspec* lspec_new(int kind, int length) {
+  lspec* ls = malloc(sizeof(lspec));
+  ls->kind = kind;
+  ls->num = 0;
+  ls->op = -1;
+  ls->length = length;
+  ls->cell = length ? calloc(length, sizeof(lspec*)) : NULL;
+  ls->jit = NULL;
+  return ls;
+}
+
+/* compile the children of an expression from start, NULL if one fails */
+static lspec* lspec_children(lenv* le, lcode* lc, lval* lv, int start,
+                             lspec* ls) {
+
+  for (int i = start; i < lv->length; i++) {
+    ls->cell[i - start] = lspec_expr(le, lc, lv->cell[i]);
+
+    if (!ls->cell[i - start]) {
+      lspec_del(ls);
+      return NULL;
+    }
+  }
+
+  return ls;
+}
+
+/* compile a list as an S-Expression, whatever its type */
+static lspec* lspec_list(lenv* le, lcode* lc, lval* lv) {
+  lval* formals = lc->formals;
+
+  if (lv->length == 0) {
+    return NULL;
+  }
+
+  /* a single expression evaluates to its only element */
+  if (lv->length == 1) {
+    return lspec_expr(le, lc, lv->cell[0]);
+  }
+
+  lval* head = lv->cell[0];
+
+  if (head->type != LVAL_SYM) {
+    return NULL;
+  }
+
+  for (int i = 0; i < formals->length; i++) {
+    if (strcmp(formals->cell[i]->sym, head->sym) == 0) {
+      return NULL;
+    }
+  }
+
+  lval* func = lenv_find(le, head);
+
+  if (!func || func->type != LVAL_FUNC || func->memo || func->partial) {
+    return NULL;
+  }
+
+  /* the code is only valid for as long as the head stays bound */
+  lopt_assume(head);
+
+  if (lop_code(func) != -1 && lv->length <= LOP_SCRATCH + 1) {
+    lspec* ls = lspec_new(LSPEC_OP, lv->length - 1);
+    ls->op = lop_code(func);
+    return lspec_children(le, lc, lv, 1, ls);
+  }
+
+  /* both branches must be there, as a missing one yields () */
+  if (func->builtin == builtin_if && lv->length == 4) {
+    lspec* ls = lspec_new(LSPEC_IF, 3);
+
+    for (int i = 0; i < 3; i++) {
+      ls->cell[i] = lspec_code(le, lc, lv->cell[i + 1]);
+
+      if (!ls->cell[i]) {
+        lspec_del(ls);
+        return NULL;
+      }
+    }
+
+    return ls;
+  }
+
+  /* recursive calls stay inside the specialized body */
+  if (!func->builtin && func->code == lc &&
+      lv->length - 1 == formals->length) {
+    lspec* ls = lspec_new(LSPEC_SELF, lv->length - 1);
+    return lspec_children(le, lc, lv, 1, ls);
+  }
+
+  return NULL;
+}
+
+/* compile code the way special forms run it, Q-Expressions as lists */
+static lspec* lspec_code(lenv* le, lcode* lc, lval* lv) {
+  if (lv->type == LVAL_QEXPR) {
+    return lspec_list(le, lc, lv);
+  }
+
+  return lspec_expr(le, lc, lv);
+}
+
+/* compile an expression, NULL if it may yield anything but a number */
+static lspec* lspec_expr(lenv* le, lcode* lc, lval* lv) {
+  lval* formals = lc->formals;
+
+  if (lv->type == LVAL_NUM) {
+    lspec* ls = lspec_new(LSPEC_NUM, 0);
+    ls->num = lv->num;
+    return ls;
+  }
+
+  /* only arguments can be read, other symbols may be rebound freely */
+  if (lv->type == LVAL_SYM) {
+    for (int i = 0; i < formals->length; i++) {
+      if (strcmp(formals->cell[i]->sym, lv->sym) == 0) {
+        lspec* ls = lspec_new(LSPEC_ARG, 0);
+        ls->num = i;
+        return ls;
+      }
+    }
+
+    return NULL;
+  }
+
+  if (lv->type == LVAL_SEXPR) {
+    return lspec_list(le, lc, lv);
+  }
+
+  return NULL;
+}
+
+/* evaluate a specialized body of a lambda, returns 0 on any error */
+static int lspec_exec(lcode* lc, lspec* ls, long* slots, long* acc) {
+  long x[LOP_SCRATCH];
+
+  switch (ls->kind) {
+
+    case LSPEC_NUM:
+      *acc = ls->num;
+      return 1;
+
+    case LSPEC_ARG:
+      *acc = slots[ls->num];
+      return 1;
+
+    case LSPEC_OP:
+      for (int i = 0; i < ls->length; i++) {
+        if (!lspec_exec(lc, ls->cell[i], slots, &x[i])) {
+          return 0;
+        }
+      }
+
+      /* results that do not fit in a long are left to the general path */
+      return lop_fold(ls->op, x, ls->length, acc) == 1;
+
+    case LSPEC_IF:
+      if (!lspec_exec(lc, ls->cell[0], slots, &x[0])) {
+        return 0;
+      }
+
+      return lspec_exec(lc, ls->cell[x[0] ? 1 : 2], slots, acc);
+
+    case LSPEC_SELF:
+      for (int i = 0; i < ls->length; i++) {
+        if (!lspec_exec(lc, ls->cell[i], slots, &x[i])) {
+          return 0;
+        }
+      }
+
+      /* recursive calls never reach lval_call, so they are counted here */
+      lc->calls++;
+      return lspec_exec(lc, lc->spec, x, acc);
+  }
+
+  return 0;
+}
+
+
+/* run the specialized body of a lambda on a list of arguments, which is
+ * left alone. Returns 0 if an argument is not a number or evaluation
+ * fails, the general path then takes over, and as the body is pure it
+ * reports the same error or the big integer result. A body that failed
+ * once is dropped, so it is not run again only to fail deeper down */
+int lspec_call(lcode* lc, lval* la, long* acc) {
+  long slots[LSPEC_SLOTS];
+
+  for (int i = 0; i < la->length; i++) {
+    if (la->cell[i]->type != LVAL_NUM) {
+      return 0;
+    }
+
+    slots[i] = la->cell[i]->num;
+  }
+
+  lc->calls++;
+
+  lspec* ls = lc->spec;
+  int ok = ls->jit && ljit_on ? ljit_call(ls->jit, slots, acc)
+                              : lspec_exec(lc, ls, slots, acc);
+
+  if (!ok) {
+    lspec_del(lc->spec);
+    lc->spec = NULL;
+    lc->tier = LTIER_OPT;
+    lc->deopts++;
+    return 0;
+  }
+
+  return 1;
+}
+
+/* compile a lambda body for integer arguments, NULL if it uses anything
+ * but its arguments, constants, arithmetic, if and calls to itself */
+lspec* lspec_compile(lenv* le, lcode* lc) {
+  lval* formals = lc->formals;
+
+  if (formals->length > LSPEC_SLOTS) {
+    return NULL;
+  }
+
+  for (int i = 0; i < formals->length; i++) {
+    if (strcmp(formals->cell[i]->sym, "&") == 0) {
+      return NULL;
+    }
+  }
+
+  lspec* ls = lspec_code(le, lc, lc->body);
+
+  /* the baseline compiler takes the body on to machine code */
+  if (ls && ljit_on) {
+    ls->jit = ljit_compile(lc, ls);
+  }
+
+  return ls;
+}
+
+void lspec_del(lspec* ls) {
+  for (int i = 0; i < ls->length; i++) {
+    if (ls->cell[i]) {
+      lspec_del(ls->cell[i]);
+    }
+  }
+
+  if (ls->jit) {
+    ljit_del(ls->jit);
+  }
+
+  free(ls->cell);
+  free(ls);
+}
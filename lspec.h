@@ -0,0 +1,45 @@
+#ifndef LSPEC_H_
+#define LSPEC_H_
+
+#include "lenv.h"
+#include "lval.h"
+
+
+/* the most formals a lambda specialized to integers can take */
+#define LSPEC_SLOTS 8
+
+/* kinds of nodes in a specialized body */
+enum {
+  LSPEC_ARG,
+  LSPEC_IF,
+  LSPEC_NUM,
+  LSPEC_OP,
+  LSPEC_SELF,
+};
+
+/* lambda body compiled for integer arguments, every value is unboxed */
+typedef struct lspec {
+  int kind;
+
+  /* constant, or slot of an argument */
+  long num;
+
+  /* operator of LSPEC_OP */
+  int op;
+
+  /* operands, the condition and branches, or the arguments of a call */
+  int length;
+  struct lspec** cell;
+
+  /* machine code of the whole body, only ever set on its root */
+  struct ljit* jit;
+} lspec;
+
+
+int lspec_call(lcode*, lval*, long*);
+
+lspec* lspec_compile(lenv*, lcode*);
+
+void lspec_del(lspec*);
+
+#endif
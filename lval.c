@@ -1,17 +1,31 @@
+#include <math.h>
 #include <stdarg.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
 #include "builtins.h"
+#include "lbig.h"
+#include "lbuf.h"
+#include "lhamt.h"
+#include "lmap.h"
+#include "lmemo.h"
+#include "lopt.h"
+#include "lrope.h"
+#include "lspec.h"
 #include "lval.h"
+#include "lvec.h"
 
 
+lval* lval_exec_sexpr(lenv*, lval*);
 lval* lval_pop(lval*, int);
 
 
 char* ltype_name(int type) {
   switch(type) {
+    case LVAL_BIG:
+      return "Bignum";
+
     case LVAL_FUNC:
       return "Function";
 
@@ -21,6 +35,9 @@ char* ltype_name(int type) {
     case LVAL_ERR:
       return "Error";
 
+    case LVAL_FLOAT:
+      return "Float";
+
     case LVAL_SYM:
       return "Symbol";
 
@@ -30,136 +47,346 @@ char* ltype_name(int type) {
     case LVAL_QEXPR:
       return "Q-Expression";
 
+    case LVAL_THUNK:
+      return "Thunk";
+
+    case LVAL_VEC:
+      return "Vector";
+
+    case LVAL_MAP:
+      return "Map";
+
+    case LVAL_PMAP:
+      return "Persistent Map";
+
+    case LVAL_PVEC:
+      return "Persistent Vector";
+
     default:
       return "Unknown";
   }
 }
 
+/* errors are equal when their message is. Only the captured arguments
+ * are compared, the slots past count are never set */
+static int lerr_eq(lerr* x, lerr* y) {
+  if (x->fmt != y->fmt || x->count != y->count) {
+    return 0;
+  }
+
+  for (int i = 0; i < x->count; i++) {
+    if (x->strs[i] != y->strs[i]) {
+      return 0;
+    }
+
+    if (x->strs[i] < 0 ? x->nums[i] != y->nums[i] :
+        strcmp(x->data + x->strs[i], y->data + y->strs[i]) != 0) {
+      return 0;
+    }
+  }
+
+  return 1;
+}
+
+/* skip the flags and width of a format directive, noting a 'l' modifier */
+static char* lerr_spec(char* p, int* wide) {
+  *wide = 0;
+
+  while (*p && strchr("-+ #0123456789.", *p)) {
+    p++;
+  }
+
+  while (*p == 'l') {
+    *wide = 1;
+    p++;
+  }
+
+  return p;
+}
+
+/* release a reference to a lambda body */
+void lcode_del(lcode* lc) {
+  if (--lc->refs > 0) {
+    return;
+  }
+
+  lval_del(lc->formals);
+  lval_del(lc->body);
+
+  if (lc->opt) {
+    lval_del(lc->opt);
+  }
+
+  if (lc->retired) {
+    lval_del(lc->retired);
+  }
+
+  if (lc->spec) {
+    lspec_del(lc->spec);
+  }
+
+  free(lc);
+}
+
+lcode* lcode_new(lval* formals, lval* body) {
+  lcode* lc = malloc(sizeof(lcode));
+  lc->refs = 1;
+  lc->formals = formals;
+  lc->body = body;
+
+  /* no optimized body yet, every body starts in the tree-walker */
+  lc->opt = NULL;
+  lc->spec = NULL;
+  lc->epoch = 0;
+  lc->types = 0;
+  lc->tier = LTIER_BASE;
+  lc->heat = 0;
+  lc->active = 0;
+  lc->retired = NULL;
+
+  lc->calls = 0;
+  lc->loops = 0;
+  lc->promotions = 0;
+  lc->deopts = 0;
+  return lc;
+}
+
+/* fill args with the arguments bound so far, in order */
+static void lpartial_flat(lpartial* lp, lval** args) {
+  if (lp->base) {
+    lpartial_flat(lp->base, args);
+  }
+
+  for (int i = 0; i < lp->args->length; i++) {
+    args[lp->length - lp->args->length + i] = lp->args->cell[i];
+  }
+}
+
+static int lpartial_eq(lpartial* x, lpartial* y) {
+  if (x == y) {
+    return 1;
+  }
+
+  if (x->func->code != y->func->code || x->length != y->length) {
+    return 0;
+  }
+
+  lval** xs = malloc(sizeof(lval*) * x->length);
+  lval** ys = malloc(sizeof(lval*) * y->length);
+  lpartial_flat(x, xs);
+  lpartial_flat(y, ys);
+
+  int eq = 1;
+
+  for (int i = 0; i < x->length && eq; i++) {
+    eq = lval_eq(xs[i], ys[i]);
+  }
+
+  free(xs);
+  free(ys);
+  return eq;
+}
+
+/* release a reference to a partial application */
+void lpartial_del(lpartial* lp) {
+  if (--lp->refs > 0) {
+    return;
+  }
+
+  lval_del(lp->func);
+  lval_del(lp->args);
+
+  if (lp->base) {
+    lpartial_del(lp->base);
+  }
+
+  free(lp);
+}
+
+/* deleted values are pooled and handed out again before malloc is
+ * asked, most of them are temporaries that die within a single call */
+#define LVAL_POOL 4096
+
+typedef union lslot {
+  union lslot* next;
+  lval lv;
+} lslot;
+
+static lslot* lval_pool = NULL;
+static int lval_pool_length = 0;
+
+static lval* lval_alloc(void) {
+  if (lval_pool) {
+    lslot* slot = lval_pool;
+    lval_pool = slot->next;
+    lval_pool_length--;
+    return &slot->lv;
+  }
+
+  return malloc(sizeof(lslot));
+}
+
 /* call a function */
 lval* lval_call(lenv* le, lval* func, lval* la) {
 
+  /* memoized functions answer from their cache when they can */
+  if (func->memo) {
+    return lmemo_call(le, func->memo, la);
+  }
+
+  /* special forms applied to values see them as their expression */
+  if (builtin_special(func)) {
+    lval* expr = lval_join(lval_add(lval_sexpr(), lval_copy(func)), la);
+    lval* acc = func->builtin(le, expr);
+    lval_del(expr);
+    return acc;
+  }
+
   /* if builtin then simply apply that */
   if (func->builtin) {
     return func->builtin(le, la);
   }
 
-  /* save argument length */
-  int provided = la->length;
-  int expected = func->args->length;
+  /* partial applications call the lambda they were made from */
+  lpartial* lp = func->partial;
+  lval* lambda = lp ? lp->func : func;
+  lval* formals = lambda->code->formals;
 
-  /* while arguments still remain to be processed */
-  while (la->length) {
+  int bound = lp ? lp->length : 0;
+  int provided = la->length;
 
-    /* if we've ran out of formal arguments to bind */
-    if (func->args->length == 0) {
-      lval_del(la);
+  /* formals before '&' are required, the symbol after it takes the rest */
+  int required = formals->length;
 
-      return lval_err(
-        "Function passed too many arguments. "
-        "Got %i, Expected %i.", provided, expected
-      );
+  for (int i = 0; i < formals->length; i++) {
+    if (strcmp(formals->cell[i]->sym, "&") == 0) {
+      required = i;
+      break;
     }
+  }
 
-    /* pop the first symbol from the args */
-    lval* symbol = lval_pop(func->args, 0);
-
-    /* special case to deal with '&' */
-    if (strcmp(symbol->sym, "&") == 0) {
+  int variadic = required < formals->length;
 
-      /* ensure '&' is followed by another symbol */
-      if (func->args->length != 1) {
-        lval_del(la);
+  /* feedback for specializing the body to the types it is called with */
+  for (int i = 0; i < provided; i++) {
+    lambda->code->types |= 1 << la->cell[i]->type;
+  }
 
-        return lval_err(
-          "Function format invalid. "
-          "Symbol '&' not followed by single symbol."
-        );
-      }
+  /* if we've ran out of formal arguments to bind */
+  if (!variadic && provided > required - bound) {
+    lval_del(la);
 
-      /* next arg should be bound to remaining arguments */
-      lval* nsymbol = lval_pop(func->args, 0);
-      lenv_put(func->env, nsymbol, builtin_list(le, la));
+    return lval_err(
+      "Function passed too many arguments. "
+      "Got %i, Expected %i.", provided, required - bound
+    );
+  }
 
-      lval_del(symbol);
-      lval_del(nsymbol);
-      break;
+  /* too few arguments, only the new ones are stored with the old ones */
+  if (provided < required - bound) {
+    if (provided == 0) {
+      lval_del(la);
+      return lval_copy(func);
     }
 
-    /* pop the next argument from the list */
-    lval* value = lval_pop(la, 0);
+    return lval_partial(func, la);
+  }
 
-    /* bind a copy into the function's environment */
-    lenv_put(func->env, symbol, value);
+  if (variadic && required != formals->length - 2) {
+    lval_del(la);
 
-    /* delete symbol and value */
-    lval_del(symbol);
-    lval_del(value);
+    return lval_err(
+      "Function format invalid. "
+      "Symbol '&' not followed by single symbol."
+    );
   }
 
-  /* argument list is now bound so can be cleaned up */
-  lval_del(la);
+  /* integer-only lambdas run unboxed while their assumptions hold, the
+   * specialized body guards against any other argument */
+  long num;
 
-  /* if '&' remains in arg list bind to empty list */
-  if (func->args->length > 0 &&
-      strcmp(func->args->cell[0]->sym, "&") == 0) {
+  if (lambda->code->spec && lambda->code->epoch == lopt_epoch &&
+      !lp && !variadic && lspec_call(lambda->code, la, &num)) {
+    lval_del(la);
+    return lval_num(num);
+  }
 
-    /* Check to ensure that & is not passed invalidly. */
-    if (func->args->length != 2) {
-      return lval_err(
-        "Function format invalid. "
-        "Symbol '&' not followed by single symbol."
-      );
-    }
+  /* bind into a fresh frame, the lambda itself is never modified */
+  lenv* frame = lenv_new();
 
-    /* pop and delete '&' symbol */
-    lval_del(lval_pop(func->args, 0));
+  /* arguments of partial applications are shared, so they are copied */
+  if (lp) {
+    lval** args = malloc(sizeof(lval*) * bound);
+    lpartial_flat(lp, args);
 
-    /* pop next symbol and create empty list */
-    lval* symbol = lval_pop(func->args, 0);
-    lval* value = lval_qexpr();
+    for (int i = 0; i < bound; i++) {
+      lenv_bind(frame, formals->cell[i], lval_copy(args[i]));
+    }
 
-    /* bind to environment and delete */
-    lenv_put(func->env, symbol, value);
+    free(args);
+  }
+
+  /* new arguments are moved into the frame, the list only carried them */
+  int taken = required - bound;
 
-    lval_del(symbol);
-    lval_del(value);
+  for (int i = 0; i < taken; i++) {
+    lenv_bind(frame, formals->cell[bound + i], la->cell[i]);
   }
 
-  /* If all args have been bound evaluate */
-  if (func->args->length == 0) {
+  /* the rest, possibly none, is bound as a list to the symbol after '&' */
+  if (variadic) {
+    lval* rest = lval_qexpr();
 
-    /* Set environment parent to evaluation environment */
-    func->env->parent = le;
+    for (int i = taken; i < provided; i++) {
+      rest = lval_add(rest, la->cell[i]);
+    }
 
-    /* Evaluate and return */
-    return builtin_eval(
-      func->env,
-      lval_add(lval_sexpr(), lval_copy(func->body))
-    );
-  } else {
-    /* Otherwise return partially evaluated function */
-    return lval_copy(func);
+    lenv_bind(frame, formals->cell[required + 1], rest);
   }
 
+  la->length = 0;
+  lval_del(la);
+
+  /* Set environment parent to evaluation environment */
+  frame->parent = le;
+
+  /* Evaluate the body of the current tier in place */
+  lcode* caller = lopt_running;
+  lval* body = lopt_enter(le, lambda->code);
+
+  lval* result = lval_exec_sexpr(frame, body);
+
+  lopt_leave(lambda->code, caller);
+  lenv_del(frame);
+  return result;
 }
 
 /* copy a lval */
 lval* lval_copy(lval* lv) {
 
-  lval* copy = malloc(sizeof(lval));
+  lval* copy = lval_alloc();
   copy->type = lv->type;
 
   switch (lv->type) {
 
     /* Copy functions and numbers directly */
     case LVAL_FUNC:
-      if (lv->builtin) {
-        copy->builtin = lv->builtin;
-      } else {
-        copy->builtin = NULL;
-        copy->env = lenv_copy(lv->env);
-        copy->args = lval_copy(lv->args);
-        copy->body = lval_copy(lv->body);
+      copy->builtin = lv->builtin;
+      copy->memo = NULL;
+      copy->partial = NULL;
+
+      if (lv->memo) {
+        /* memoized functions share their cache */
+        copy->memo = lv->memo;
+        copy->memo->refs++;
+      } else if (lv->partial) {
+        /* bound arguments are never modified so copies share them */
+        copy->partial = lv->partial;
+        copy->partial->refs++;
+      } else if (!lv->builtin) {
+        /* neither is the body, formals and all */
+        copy->code = lv->code;
+        copy->code->refs++;
       }
       break;
 
@@ -167,10 +394,20 @@ lval* lval_copy(lval* lv) {
       copy->num = lv->num;
       break;
 
+    case LVAL_FLOAT:
+      copy->flt = lv->flt;
+      break;
+
+    /* big integers are immutable so copies share them */
+    case LVAL_BIG:
+      copy->big = lv->big;
+      copy->big->refs++;
+      break;
+
     /* Copy strings using malloc and strcpy */
     case LVAL_ERR:
-      copy->err = malloc(strlen(lv->err) + 1);
-      strcpy(copy->err, lv->err);
+      copy->err = malloc(lv->err->size);
+      memcpy(copy->err, lv->err, lv->err->size);
       break;
 
     case LVAL_SYM:
@@ -178,6 +415,37 @@ lval* lval_copy(lval* lv) {
       strcpy(copy->sym, lv->sym);
       break;
 
+    /* thunks share their state so they are evaluated only once */
+    case LVAL_THUNK:
+      copy->thunk = lv->thunk;
+      copy->thunk->refs++;
+      break;
+
+    /* vectors and maps are shared by reference, copies see every change */
+    case LVAL_VEC:
+      copy->vec = lv->vec;
+      copy->vec->refs++;
+      break;
+
+    case LVAL_MAP:
+      copy->map = lv->map;
+      copy->map->refs++;
+      break;
+
+    /* persistent maps and vectors never change, every version is shared */
+    case LVAL_PMAP:
+      copy->hamt = lv->hamt;
+      copy->hamt->refs++;
+      break;
+
+    case LVAL_PVEC:
+      copy->rope = lv->rope;
+
+      if (copy->rope) {
+        copy->rope->refs++;
+      }
+      break;
+
     /* Copy lists by copying each sub-expression recursively */
     case LVAL_SEXPR:
     case LVAL_QEXPR:
@@ -194,69 +462,453 @@ lval* lval_copy(lval* lv) {
   return copy;
 }
 
+/* check if x is the vector or map y or holds it at any depth, as storing
+ * x inside y would then make a cycle */
+int lval_contains(lval* x, lval* y) {
+  switch (x->type) {
+    case LVAL_MAP:
+      if (y->type == LVAL_MAP && x->map == y->map) {
+        return 1;
+      }
+
+      for (long i = 0; i < x->map->size; i++) {
+        lmap_slot* slot = &x->map->slots[i];
+
+        if (slot->key && (lval_contains(slot->key, y) ||
+                          lval_contains(slot->value, y))) {
+          return 1;
+        }
+      }
+
+      return 0;
+
+    /* a new version can still hold a vector or map that holds it */
+    case LVAL_PMAP:
+      return lhamt_holds(x->hamt, y);
+
+    case LVAL_PVEC:
+      return lrope_holds(x->rope, y);
+
+    case LVAL_VEC:
+      if (y->type == LVAL_VEC && x->vec == y->vec) {
+        return 1;
+      }
+
+      if (x->vec->kind == LVEC_ANY) {
+        for (long i = 0; i < x->vec->length; i++) {
+          if (lval_contains(x->vec->cells[i], y)) {
+            return 1;
+          }
+        }
+      }
+
+      return 0;
+
+    case LVAL_QEXPR:
+    case LVAL_SEXPR:
+      for (int i = 0; i < x->length; i++) {
+        if (lval_contains(x->cell[i], y)) {
+          return 1;
+        }
+      }
+
+      return 0;
+  }
+
+  return 0;
+}
+
+/* check if two lvals are structurally equal */
+int lval_eq(lval* x, lval* y) {
+
+  if (x->type != y->type) {
+    return 0;
+  }
+
+  switch (x->type) {
+
+    case LVAL_NUM:
+      return x->num == y->num;
+
+    case LVAL_BIG:
+      return lbig_cmp(x->big, y->big) == 0;
+
+    case LVAL_FLOAT:
+      return x->flt == y->flt;
+
+    case LVAL_ERR:
+      return lerr_eq(x->err, y->err);
+
+    case LVAL_SYM:
+      return strcmp(x->sym, y->sym) == 0;
+
+    case LVAL_THUNK:
+      return x->thunk == y->thunk;
+
+    case LVAL_VEC:
+      return lvec_eq(x->vec, y->vec);
+
+    case LVAL_MAP:
+      return lmap_eq(x->map, y->map);
+
+    case LVAL_PMAP:
+      return lhamt_eq(x->hamt, y->hamt);
+
+    case LVAL_PVEC:
+      return lrope_eq(x->rope, y->rope);
+
+    /* builtins and memoized functions by identity, lambdas by their code
+     * and partial applications also by the values bound so far */
+    case LVAL_FUNC:
+      if (x->memo || y->memo) {
+        return x->memo == y->memo;
+      }
+
+      if (x->builtin || y->builtin) {
+        return x->builtin == y->builtin;
+      }
+
+      if (!x->partial || !y->partial) {
+        return x->partial == y->partial && x->code == y->code;
+      }
+
+      return lpartial_eq(x->partial, y->partial);
+
+    case LVAL_QEXPR:
+    case LVAL_SEXPR:
+      if (x->length != y->length) {
+        return 0;
+      }
+
+      for (int i = 0; i < x->length; i++) {
+        if (!lval_eq(x->cell[i], y->cell[i])) {
+          return 0;
+        }
+      }
+
+      return 1;
+  }
+
+  return 0;
+}
+
 /* construct a pointer to a new Error lval */
 lval* lval_err(char* fmt, ...) {
-  lval* lv = malloc(sizeof(lval));
-  lv->type = LVAL_ERR;
+  long nums[LERR_ARGS];
+  char* strs[LERR_ARGS];
+  int count = 0;
+  int bytes = 0;
 
   /* Create a va list and initialize it */
   va_list va;
   va_start(va, fmt);
 
-  /* Allocate 512 bytes of space */
-  lv->err = malloc(512);
+  /* capture the arguments, only strings need to be copied */
+  for (char* p = fmt; *p && count < LERR_ARGS; p++) {
+    if (*p != '%') {
+      continue;
+    }
+
+    int wide;
+    p = lerr_spec(p + 1, &wide);
 
-  /* printf the error string with a maximum of 511 characters */
-  vsnprintf(lv->err, 511, fmt, va);
+    if (*p == '\0') {
+      break;
+    }
 
-  /* Reallocate to number of bytes actually used */
-  lv->err = realloc(lv->err, strlen(lv->err)+1);
+    switch (*p) {
+      case 's':
+        strs[count] = va_arg(va, char*);
+        bytes += strlen(strs[count]) + 1;
+        count++;
+        break;
+
+      case 'c':
+      case 'd':
+      case 'i':
+        nums[count] = wide ? va_arg(va, long) : va_arg(va, int);
+        strs[count] = NULL;
+        count++;
+        break;
+    }
+  }
 
   /* Cleanup our va list */
   va_end(va);
 
+  /* a single allocation holds the arguments and the strings */
+  lerr* er = malloc(sizeof(lerr) + bytes);
+  er->size = sizeof(lerr) + bytes;
+  er->fmt = fmt;
+  er->count = count;
+
+  for (int i = 0, offset = 0; i < count; i++) {
+    er->nums[i] = 0;
+    er->strs[i] = -1;
+
+    if (strs[i]) {
+      er->strs[i] = offset;
+      strcpy(er->data + offset, strs[i]);
+      offset += strlen(strs[i]) + 1;
+    } else {
+      er->nums[i] = nums[i];
+    }
+  }
+
+  lval* lv = lval_alloc();
+  lv->type = LVAL_ERR;
+  lv->err = er;
+  return lv;
+}
+
+/* write an error message from its format and captured arguments */
+void lval_err_write(lbuf* lb, lerr* er) {
+  int arg = 0;
+
+  for (char* p = er->fmt; *p; p++) {
+    if (*p != '%') {
+      lbuf_char(lb, *p);
+      continue;
+    }
+
+    int wide;
+    p = lerr_spec(p + 1, &wide);
+
+    if (*p == '\0') {
+      break;
+    }
+
+    if (*p == '%') {
+      lbuf_char(lb, '%');
+      continue;
+    }
+
+    if (arg >= er->count) {
+      continue;
+    }
+
+    if (er->strs[arg] >= 0) {
+      lbuf_str(lb, er->data + er->strs[arg]);
+    } else if (*p == 'c') {
+      lbuf_char(lb, (char) er->nums[arg]);
+    } else {
+      lbuf_long(lb, er->nums[arg]);
+    }
+
+    arg++;
+  }
+}
+
+/* force thunks until a value is reached, each one is evaluated only once */
+lval* lval_force(lenv* le, lval* lv) {
+
+  while (lv->type == LVAL_THUNK) {
+    lthunk* lt = lv->thunk;
+
+    if (!lt->value) {
+
+      if (lt->forcing) {
+        lval_del(lv);
+        return lval_err("Thunk forced while it is being evaluated.");
+      }
+
+      /* evaluate with the captured values in front of the environment */
+      lt->forcing = 1;
+      lt->env->parent = le;
+      lval* value = lval_exec_sexpr(lt->env, lt->expr);
+      lt->forcing = 0;
+
+      /* errors are not cached so forcing again retries */
+      if (value->type == LVAL_ERR) {
+        lval_del(lv);
+        return value;
+      }
+
+      /* the expression is not needed anymore once the value is known */
+      lt->value = value;
+      lenv_del(lt->env);
+      lval_del(lt->expr);
+      lt->env = NULL;
+      lt->expr = NULL;
+    }
+
+    lval* value = lval_copy(lt->value);
+    lval_del(lv);
+    lv = value;
+  }
+
+  return lv;
+}
+
+/* construct a pointer to a new Float lval */
+lval* lval_float(double flt) {
+  lval* lv = lval_alloc();
+  lv->type = LVAL_FLOAT;
+  lv->flt = flt;
   return lv;
 }
 
 /* construct a pointer to a new Func lval */
 lval* lval_func(lbuiltin func) {
-  lval* lv = malloc(sizeof(lval));
+  lval* lv = lval_alloc();
   lv->type = LVAL_FUNC;
   lv->builtin = func;
+  lv->memo = NULL;
+  lv->partial = NULL;
   return lv;
 }
 
-lval* lval_join(lval* x, lval* y) {
-  /* for each cell in 'y' add it to 'x' */
-  while (y->length) {
-    x = lval_add(x, lval_pop(y, 0));
+/* mix a word into a FNV-1a style hash */
+static unsigned long lval_hash_mix(unsigned long hash, unsigned long word) {
+  return (hash ^ word) * 1099511628211UL;
+}
+
+/* structural hash, equal lvals as per lval_eq hash the same */
+unsigned long lval_hash(lval* lv) {
+  unsigned long hash = lval_hash_mix(14695981039346656037UL, lv->type);
+
+  switch (lv->type) {
+
+    case LVAL_NUM:
+      return lval_hash_mix(hash, lv->num);
+
+    case LVAL_BIG:
+      return lval_hash_mix(hash, lbig_hash(lv->big));
+
+    /* both zeros are equal so they hash the same */
+    case LVAL_FLOAT: {
+      double flt = lv->flt == 0 ? 0 : lv->flt;
+      unsigned long bits;
+      memcpy(&bits, &flt, sizeof(bits));
+      return lval_hash_mix(hash, bits);
+    }
+
+    case LVAL_ERR:
+      return lval_hash_mix(hash, (unsigned long) lv->err->fmt);
+
+    case LVAL_SYM:
+      for (char* p = lv->sym; *p; p++) {
+        hash = lval_hash_mix(hash, (unsigned char) *p);
+      }
+      return hash;
+
+    case LVAL_FUNC:
+      if (lv->memo) {
+        return lval_hash_mix(hash, (unsigned long) lv->memo);
+      }
+
+      if (lv->builtin) {
+        return lval_hash_mix(hash, (unsigned long) lv->builtin);
+      }
+
+      if (lv->partial) {
+        lval** args = malloc(sizeof(lval*) * lv->partial->length);
+        lpartial_flat(lv->partial, args);
+
+        hash = lval_hash_mix(hash, (unsigned long) lv->partial->func->code);
+
+        for (int i = 0; i < lv->partial->length; i++) {
+          hash = lval_hash_mix(hash, lval_hash(args[i]));
+        }
+
+        free(args);
+        return hash;
+      }
+
+      return lval_hash_mix(hash, (unsigned long) lv->code);
+
+    case LVAL_THUNK:
+      return lval_hash_mix(hash, (unsigned long) lv->thunk);
+
+    case LVAL_VEC:
+      return lval_hash_mix(hash, lvec_hash(lv->vec));
+
+    case LVAL_MAP:
+      return lval_hash_mix(hash, lmap_hash(lv->map));
+
+    case LVAL_PMAP:
+      return lval_hash_mix(hash, lhamt_hash(lv->hamt));
+
+    case LVAL_PVEC:
+      return lval_hash_mix(hash, lrope_hash(lv->rope));
+
+    case LVAL_QEXPR:
+    case LVAL_SEXPR:
+      hash = lval_hash_mix(hash, lv->length);
+
+      for (int i = 0; i < lv->length; i++) {
+        hash = lval_hash_mix(hash, lval_hash(lv->cell[i]));
+      }
+      return hash;
   }
 
-  /* delete the empty 'y' and return 'x' */
+  return hash;
+}
+
+lval* lval_join(lval* x, lval* y) {
+  /* move the cells of 'y' to the end of 'x' all at once */
+  x->cell = realloc(x->cell, sizeof(lval*) * (x->length + y->length));
+  memcpy(x->cell + x->length, y->cell, sizeof(lval*) * y->length);
+  x->length += y->length;
+
+  /* delete the emptied 'y' and return 'x' */
+  y->length = 0;
   lval_del(y);
   return x;
 }
 
 lval* lval_lambda(lval* args, lval* body) {
-  lval* lv = malloc(sizeof(lval));
+  lval* lv = lval_alloc();
   lv->type = LVAL_FUNC;
 
   /* set func to null */
   lv->builtin = NULL;
+  lv->memo = NULL;
+  lv->partial = NULL;
 
-  /* build new environment */
-  lv->env = lenv_new();
+  /* formals and body are shared by all copies and never modified */
+  lv->code = lcode_new(args, body);
 
-  /* set args and body */
-  lv->args = args;
-  lv->body = body;
+  return lv;
+}
 
+/* construct a pointer to a new memoized Func lval wrapping a function */
+lval* lval_memo(lval* func, int capacity) {
+  lval* lv = lval_alloc();
+  lv->type = LVAL_FUNC;
+  lv->builtin = NULL;
+  lv->memo = lmemo_new(func, capacity);
+  lv->partial = NULL;
+  return lv;
+}
+
+/* apply a lambda, or a partial application of one, to too few arguments */
+lval* lval_partial(lval* func, lval* args) {
+  lpartial* lp = malloc(sizeof(lpartial));
+  lp->refs = 1;
+  lp->args = args;
+  lp->base = func->partial;
+
+  if (lp->base) {
+    lp->base->refs++;
+    lp->func = lval_copy(lp->base->func);
+    lp->length = lp->base->length + args->length;
+  } else {
+    lp->func = lval_copy(func);
+    lp->length = args->length;
+  }
+
+  lval* lv = lval_alloc();
+  lv->type = LVAL_FUNC;
+  lv->builtin = NULL;
+  lv->memo = NULL;
+  lv->partial = lp;
   return lv;
 }
 
 /* construct a pointer to a new empty Qexpr lval */
 lval* lval_qexpr(void) {
-  lval* lv = malloc(sizeof(lval));
+  lval* lv = lval_alloc();
   lv->type = LVAL_QEXPR;
   lv->length = 0;
   lv->cell = NULL;
@@ -265,7 +917,7 @@ lval* lval_qexpr(void) {
 
 /* construct a pointer to a new Number lval */
 lval* lval_num(long num) {
-  lval* lv = malloc(sizeof(lval));
+  lval* lv = lval_alloc();
   lv->type = LVAL_NUM;
   lv->num = num;
   return lv;
@@ -273,7 +925,7 @@ lval* lval_num(long num) {
 
 /* construct a pointer to a new empty Sexpr lval */
 lval* lval_sexpr(void) {
-  lval* lv = malloc(sizeof(lval));
+  lval* lv = lval_alloc();
   lv->type = LVAL_SEXPR;
   lv->length = 0;
   lv->cell = NULL;
@@ -282,13 +934,61 @@ lval* lval_sexpr(void) {
 
 /* construct a pointer to a new Symbol lval */
 lval* lval_sym(char* sym) {
-  lval* lv = malloc(sizeof(lval));
+  lval* lv = lval_alloc();
   lv->type = LVAL_SYM;
   lv->sym = malloc(strlen(sym) + 1);
   strcpy(lv->sym, sym);
   return lv;
 }
 
+/* construct a pointer to a new Thunk lval delaying an expression */
+lval* lval_thunk(lenv* env, lval* expr) {
+  lthunk* lt = malloc(sizeof(lthunk));
+  lt->refs = 1;
+  lt->forcing = 0;
+  lt->env = env;
+  lt->expr = expr;
+  lt->value = NULL;
+
+  lval* lv = lval_alloc();
+  lv->type = LVAL_THUNK;
+  lv->thunk = lt;
+  return lv;
+}
+
+/* construct a pointer to a new Map lval, taking the reference */
+lval* lval_map(lmap* map) {
+  lval* lv = lval_alloc();
+  lv->type = LVAL_MAP;
+  lv->map = map;
+  return lv;
+}
+
+/* construct a pointer to a new Persistent Map lval, taking the reference */
+lval* lval_pmap(lhamt* hamt) {
+  lval* lv = lval_alloc();
+  lv->type = LVAL_PMAP;
+  lv->hamt = hamt;
+  return lv;
+}
+
+/* construct a pointer to a new Persistent Vector lval, taking the
+ * reference */
+lval* lval_pvec(lrope* rope) {
+  lval* lv = lval_alloc();
+  lv->type = LVAL_PVEC;
+  lv->rope = rope;
+  return lv;
+}
+
+/* construct a pointer to a new Vector lval, taking the reference */
+lval* lval_vec(lvec* vec) {
+  lval* lv = lval_alloc();
+  lv->type = LVAL_VEC;
+  lv->vec = vec;
+  return lv;
+}
+
 /* append a lval to another one */
 lval* lval_add(lval* this, lval* that) {
   this->length++;
@@ -297,25 +997,43 @@ lval* lval_add(lval* this, lval* that) {
   return this;
 }
 
+/* construct a pointer to a new Bignum lval, taking the reference */
+lval* lval_big(lbig* big) {
+  lval* lv = lval_alloc();
+  lv->type = LVAL_BIG;
+  lv->big = big;
+  return lv;
+}
+
 /* deallocate a lval struct */
 void lval_del(lval* lv) {
 
   switch (lv->type) {
     /* do nothing special for func and number type */
     case LVAL_FUNC:
-      if (!lv->builtin) {
-        lenv_del(lv->env);
-        lval_del(lv->args);
-        lval_del(lv->body);
+      if (lv->memo) {
+        lmemo_del(lv->memo);
+      } else if (lv->partial) {
+        lpartial_del(lv->partial);
+      } else if (!lv->builtin) {
+        lcode_del(lv->code);
       }
       break;
 
+    case LVAL_FLOAT:
     case LVAL_NUM: break;
+    case LVAL_BIG: lbig_del(lv->big); break;
 
     /* for Err or Sym free the string data */
     case LVAL_ERR: free(lv->err); break;
     case LVAL_SYM: free(lv->sym); break;
 
+    case LVAL_THUNK: lthunk_del(lv->thunk); break;
+    case LVAL_VEC: lvec_del(lv->vec); break;
+    case LVAL_MAP: lmap_del(lv->map); break;
+    case LVAL_PMAP: lhamt_del(lv->hamt); break;
+    case LVAL_PVEC: lrope_del(lv->rope); break;
+
     /* if Qexpr or Sexpr then delete all elements inside */
     case LVAL_QEXPR:
     case LVAL_SEXPR:
@@ -327,67 +1045,229 @@ void lval_del(lval* lv) {
     break;
   }
 
-  /* free the memory allocated for the "lval" struct itself */
-  free(lv);
+  /* return the "lval" struct itself to the pool */
+  if (lval_pool_length < LVAL_POOL) {
+    ((lslot*) lv)->next = lval_pool;
+    lval_pool = (lslot*) lv;
+    lval_pool_length++;
+  } else {
+    free(lv);
+  }
+}
+
+/* write a float in a form that reads back the same, always with a point
+ * or an exponent so it stays a float. Values with few decimals, the
+ * common case, are written digit by digit rather than through printf */
+void lval_float_write(lbuf* lb, double flt) {
+  static const double scale[] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11, 1e12,
+    1e13, 1e14, 1e15
+  };
+
+  char buf[32];
+
+  if (flt > -1e15 && flt < 1e15) {
+    for (int k = 0; k < 16; k++) {
+      double m = flt * scale[k];
+
+      /* the decimal mantissa and its scale are exact, so dividing them
+       * rounds the same way reading the digits does */
+      if (m <= -9007199254740992.0 || m >= 9007199254740992.0) {
+        break;
+      }
+
+      long mant = (long) m;
+
+      if (mant != m || mant / scale[k] != flt) {
+        continue;
+      }
+
+      /* digits of the mantissa from the end, with the point k in */
+      char* p = buf + sizeof(buf);
+      unsigned long mag = mant < 0 ? -mant : mant;
+      int digits = 0;
+
+      *--p = '\0';
+
+      if (k == 0) {
+        *--p = '0';
+        *--p = '.';
+      }
+
+      while (mag > 0 || digits <= k) {
+        *--p = '0' + mag % 10;
+        mag /= 10;
+
+        if (++digits == k) {
+          *--p = '.';
+        }
+      }
+
+      if (mant < 0 || (mant == 0 && signbit(flt))) {
+        *--p = '-';
+      }
+
+      lbuf_str(lb, p);
+      return;
+    }
+  }
+
+  /* otherwise the shortest of the usual precisions that reads back */
+  for (int precision = 15; precision <= 17; precision++) {
+    snprintf(buf, sizeof(buf), "%.*g", precision, flt);
+
+    if (strtod(buf, NULL) == flt) {
+      break;
+    }
+  }
+
+  if (!strpbrk(buf, ".e")) {
+    strcat(buf, ".0");
+  }
+
+  lbuf_str(lb, buf);
 }
 
-void lval_expr_print(lval* lv, char open, char close) {
-  putchar(open);
+void lval_expr_write(lbuf* lb, lval* lv, char open, char close) {
+  lbuf_char(lb, open);
 
   for (int i = 0; i < lv->length; i++) {
 
-    /* print value contained within */
-    lval_print(lv->cell[i]);
+    /* write value contained within */
+    lval_write(lb, lv->cell[i]);
 
-    /* don't print trailing space if last element */
+    /* don't write trailing space if last element */
     if (i != (lv->length - 1)) {
-      putchar(' ');
+      lbuf_char(lb, ' ');
     }
   }
 
-  putchar(close);
+  lbuf_char(lb, close);
 }
 
-/* print an "lval" */
-void lval_print(lval* lv) {
+/* write an "lval" into a buffer */
+void lval_write(lbuf* lb, lval* lv) {
   switch (lv->type) {
 
     case LVAL_ERR:
-      printf("Error: %s", lv->err);
+      lbuf_str(lb, "Error: ");
+      lval_err_write(lb, lv->err);
       break;
 
     case LVAL_FUNC:
-      if (lv->builtin) {
-        printf("<func>");
+      if (lv->memo) {
+        lbuf_str(lb, "(memo ");
+        lval_write(lb, lv->memo->func);
+        lbuf_char(lb, ')');
+      } else if (lv->builtin) {
+        lbuf_str(lb, "<func>");
+      } else if (lv->partial) {
+        /* printed as a lambda taking the formals that are left */
+        lval* formals = lv->partial->func->code->formals;
+
+        lbuf_str(lb, "(\\ {");
+
+        for (int i = lv->partial->length; i < formals->length; i++) {
+          lval_write(lb, formals->cell[i]);
+
+          if (i != formals->length - 1) {
+            lbuf_char(lb, ' ');
+          }
+        }
+
+        lbuf_str(lb, "} ");
+        lval_write(lb, lv->partial->func->code->body);
+        lbuf_char(lb, ')');
       } else {
-        printf("(\\ ");
-        lval_print(lv->args);
-        putchar(' ');
-        lval_print(lv->body);
-        putchar(')');
+        lbuf_str(lb, "(\\ ");
+        lval_write(lb, lv->code->formals);
+        lbuf_char(lb, ' ');
+        lval_write(lb, lv->code->body);
+        lbuf_char(lb, ')');
       }
       break;
 
     case LVAL_NUM:
-      printf("%li", lv->num);
+      lbuf_long(lb, lv->num);
+      break;
+
+    case LVAL_BIG:
+      lbig_write(lb, lv->big);
+      break;
+
+    case LVAL_FLOAT:
+      lval_float_write(lb, lv->flt);
       break;
 
     case LVAL_QEXPR:
-      lval_expr_print(lv, '{', '}');
+      lval_expr_write(lb, lv, '{', '}');
       break;
 
     case LVAL_SEXPR:
-      lval_expr_print(lv, '(', ')');
+      lval_expr_write(lb, lv, '(', ')');
       break;
 
     case LVAL_SYM:
-      printf("%s", lv->sym);
+      lbuf_str(lb, lv->sym);
+      break;
+
+    case LVAL_THUNK:
+      lbuf_str(lb, "<thunk>");
+      break;
+
+    case LVAL_VEC:
+      lvec_write(lb, lv->vec);
+      break;
+
+    case LVAL_MAP:
+      lmap_write(lb, lv->map);
+      break;
+
+    case LVAL_PMAP:
+      lhamt_write(lb, lv->hamt);
+      break;
+
+    case LVAL_PVEC:
+      lrope_write(lb, lv->rope);
       break;
   }
 }
 
+/* release a reference to a thunk */
+void lthunk_del(lthunk* lt) {
+  if (--lt->refs > 0) {
+    return;
+  }
+
+  if (lt->value) {
+    lval_del(lt->value);
+  } else {
+    lenv_del(lt->env);
+    lval_del(lt->expr);
+  }
+
+  free(lt);
+}
+
+/* buffer top-level values are printed through, kept between them */
+static lbuf lval_out;
+
+/* print an "lval" in a single write */
+void lval_print(lval* lv) {
+  lval_write(&lval_out, lv);
+  lbuf_flush(&lval_out, stdout);
+}
+
 /* print an "lval" followed by a newline */
 void lval_println(lval* lv) {
-  lval_print(lv);
-  putchar('\n');
+  lval_write(&lval_out, lv);
+  lbuf_char(&lval_out, '\n');
+  lbuf_flush(&lval_out, stdout);
+}
+
+/* render an "lval" as a new string, freed by the caller */
+char* lval_to_string(lval* lv) {
+  lbuf lb = { 0, 0, NULL };
+  lval_write(&lb, lv);
+  return lbuf_string(&lb);
 }
@@ -4,26 +4,131 @@
 #include "lenv.h"
 
 /* Forward declarations */
+struct lbig;
+struct lbuf;
+struct lhamt;
+struct lmap;
+struct lmemo;
+struct lrope;
+struct lspec;
+struct lvec;
 struct lval;
 typedef struct lval lval;
 
 typedef lval*(*lbuiltin)(lenv*, lval*);
 
+/* the most arguments an error message can carry */
+#define LERR_ARGS 6
+
+/* error message, only formatted when it is printed. The format string
+ * identifies the message, string arguments are copied into data */
+typedef struct lerr {
+  int size;
+  char* fmt;
+
+  int count;
+  long nums[LERR_ARGS];
+  int strs[LERR_ARGS];
+
+  char data[];
+} lerr;
+
+/* body of a lambda and its tiering state, shared between all copies */
+typedef struct lcode {
+  int refs;
+
+  lval* formals;
+  lval* body;
+
+  /* optimized body and the one specialized to integer arguments, only
+   * valid while epoch matches lopt_epoch */
+  lval* opt;
+  struct lspec* spec;
+  long epoch;
+
+  /* types seen as arguments, a bit for each */
+  int types;
+
+  /* tier the body runs in and how hot it got since it entered it */
+  int tier;
+  long heat;
+
+  /* calls running the body, and optimized bodies dropped while running */
+  int active;
+  lval* retired;
+
+  /* calls, loop iterations and tier transitions over its lifetime */
+  long calls;
+  long loops;
+  long promotions;
+  long deopts;
+} lcode;
+
+/* delayed computation, evaluated at most once and shared between copies.
+ * env holds the values of the local symbols expr uses */
+typedef struct lthunk {
+  int refs;
+  int forcing;
+
+  lenv* env;
+  lval* expr;
+  lval* value;
+} lthunk;
+
+/* a lambda applied to fewer arguments than it takes, shared between
+ * copies. Only the arguments of this application are stored, those bound
+ * before it are in base */
+typedef struct lpartial {
+  int refs;
+
+  lval* func;
+  lval* args;
+
+  /* arguments bound so far, including those in base */
+  int length;
+  struct lpartial* base;
+} lpartial;
+
 /* declare new lval struct */
 struct lval {
   int type;
 
   long num;
 
+  /* integer that does not fit in num */
+  struct lbig* big;
+
+  /* floating point number, held in place like num */
+  double flt;
+
   /* error and symbol types have some string data */
-  char* err;
+  lerr* err;
   char* sym;
 
   /* function */
   lbuiltin builtin;
-  lenv* env;
-  lval* args;
-  lval* body;
+  lcode* code;
+
+  /* cache of a memoized function, which has no builtin or code itself */
+  struct lmemo* memo;
+
+  /* partial application, which has no builtin, code or cache itself */
+  lpartial* partial;
+
+  /* thunk */
+  lthunk* thunk;
+
+  /* vector of values in a growable buffer */
+  struct lvec* vec;
+
+  /* hash map from values to values */
+  struct lmap* map;
+
+  /* persistent map, a version of a hash array mapped trie */
+  struct lhamt* hamt;
+
+  /* persistent vector, NULL when empty */
+  struct lrope* rope;
 
   /* length and pointer to a list of "lval*" */
   int length;
@@ -33,31 +138,63 @@ struct lval {
 
 /* create enumeration of possible lval types */
 enum {
+  LVAL_BIG,
   LVAL_ERR,
+  LVAL_FLOAT,
   LVAL_FUNC,
+  LVAL_MAP,
   LVAL_NUM,
+  LVAL_PMAP,
+  LVAL_PVEC,
   LVAL_QEXPR,
   LVAL_SEXPR,
   LVAL_SYM,
+  LVAL_THUNK,
+  LVAL_VEC,
 };
 
 char* ltype_name(int);
+char* lval_to_string(lval*);
+
+lcode* lcode_new(lval*, lval*);
+
 
 lval* lval_add(lval*, lval*);
+lval* lval_big(struct lbig*);
 lval* lval_call(lenv*, lval*, lval*);
 lval* lval_copy(lval*);
 lval* lval_err(char*, ...);
+lval* lval_float(double);
+lval* lval_force(lenv*, lval*);
 lval* lval_func(lbuiltin);
 lval* lval_join(lval*, lval*);
 lval* lval_lambda(lval*, lval*);
+lval* lval_map(struct lmap*);
+lval* lval_memo(lval*, int);
 lval* lval_num(long);
+lval* lval_partial(lval*, lval*);
+lval* lval_pmap(struct lhamt*);
+lval* lval_pvec(struct lrope*);
 lval* lval_qexpr(void);
 lval* lval_sexpr(void);
 lval* lval_sym(char*);
+lval* lval_thunk(lenv*, lval*);
+lval* lval_vec(struct lvec*);
+
+int lval_contains(lval*, lval*);
+int lval_eq(lval*, lval*);
+
+unsigned long lval_hash(lval*);
 
+void lcode_del(lcode*);
+void lpartial_del(lpartial*);
 void lval_del(lval*);
-void lval_expr_print(lval*, char, char);
+void lval_err_write(struct lbuf*, lerr*);
+void lval_expr_write(struct lbuf*, lval*, char, char);
+void lval_float_write(struct lbuf*, double);
 void lval_print(lval*);
 void lval_println(lval*);
+void lval_write(struct lbuf*, lval*);
+void lthunk_del(lthunk*);
 
 #endif
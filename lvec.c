@@ -0,0 +1,934 @@
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "builtins.h"
+#include "lbig.h"
+#include "lbuf.h"
+#include "lval.h"
+#include "lvec.h"
+
+/* on x86-64 the kernels also come in AVX2, picked at run time so the
+ * build needs no special flags */
+#if defined(__x86_64__) && defined(__GNUC__)
+#define LVEC_AVX2
+#include <immintrin.h>
+#define LVEC_TARGET __attribute__((target("avx2")))
+#endif
+
+
+#ifdef LVEC_AVX2
+
+static int lvec_avx2(void) {
+  static int supported = -1;
+
+  if (supported < 0) {
+    __builtin_cpu_init();
+    supported = __builtin_cpu_supports("avx2") != 0;
+  }
+
+  return supported;
+}
+
+/* lanes that overflowed adding x and y into r have the sign bit set */
+LVEC_TARGET
+static __m256i lvec_avx2_overflow(__m256i x, __m256i y, __m256i r) {
+  return _mm256_and_si256(_mm256_xor_si256(x, r), _mm256_xor_si256(y, r));
+}
+
+LVEC_TARGET
+static int lvec_avx2_add_ints(long* r, long* x, long* y, long length) {
+  __m256i over = _mm256_setzero_si256();
+  long i = 0;
+
+  for (; i + 4 <= length; i += 4) {
+    __m256i a = _mm256_loadu_si256((__m256i*) (x + i));
+    __m256i b = _mm256_loadu_si256((__m256i*) (y + i));
+    __m256i c = _mm256_add_epi64(a, b);
+
+    over = _mm256_or_si256(over, lvec_avx2_overflow(a, b, c));
+    _mm256_storeu_si256((__m256i*) (r + i), c);
+  }
+
+  if (_mm256_movemask_pd(_mm256_castsi256_pd(over))) {
+    return 0;
+  }
+
+  for (; i < length; i++) {
+    if (__builtin_add_overflow(x[i], y[i], &r[i])) {
+      return 0;
+    }
+  }
+
+  return 1;
+}
+
+LVEC_TARGET
+static void lvec_avx2_add_flts(double* r, double* x, double* y, long length) {
+  long i = 0;
+
+  for (; i + 4 <= length; i += 4) {
+    __m256d a = _mm256_loadu_pd(x + i);
+    __m256d b = _mm256_loadu_pd(y + i);
+    _mm256_storeu_pd(r + i, _mm256_add_pd(a, b));
+  }
+
+  for (; i < length; i++) {
+    r[i] = x[i] + y[i];
+  }
+}
+
+LVEC_TARGET
+static double lvec_avx2_dot_flts(double* x, double* y, long length) {
+  __m256d acc = _mm256_setzero_pd();
+  long i = 0;
+
+  for (; i + 4 <= length; i += 4) {
+    __m256d a = _mm256_loadu_pd(x + i);
+    __m256d b = _mm256_loadu_pd(y + i);
+    acc = _mm256_add_pd(acc, _mm256_mul_pd(a, b));
+  }
+
+  double lanes[4];
+  _mm256_storeu_pd(lanes, acc);
+  double result = (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+
+  for (; i < length; i++) {
+    result += x[i] * y[i];
+  }
+
+  return result;
+}
+
+LVEC_TARGET
+static double lvec_avx2_extreme_flts(double* x, long length, int max) {
+  __m256d acc = _mm256_set1_pd(x[0]);
+  long i = 0;
+
+  for (; i + 4 <= length; i += 4) {
+    __m256d a = _mm256_loadu_pd(x + i);
+    acc = max ? _mm256_max_pd(acc, a) : _mm256_min_pd(acc, a);
+  }
+
+  double lanes[4];
+  _mm256_storeu_pd(lanes, acc);
+  double result = lanes[0];
+
+  for (int j = 1; j < 4; j++) {
+    result = (max ? lanes[j] > result : lanes[j] < result) ? lanes[j] : result;
+  }
+
+  for (; i < length; i++) {
+    result = (max ? x[i] > result : x[i] < result) ? x[i] : result;
+  }
+
+  return result;
+}
+
+LVEC_TARGET
+static long lvec_avx2_extreme_ints(long* x, long length, int max) {
+  __m256i acc = _mm256_set1_epi64x(x[0]);
+  long i = 0;
+
+  for (; i + 4 <= length; i += 4) {
+    __m256i a = _mm256_loadu_si256((__m256i*) (x + i));
+    __m256i take = max ? _mm256_cmpgt_epi64(a, acc) : _mm256_cmpgt_epi64(acc, a);
+    acc = _mm256_blendv_epi8(acc, a, take);
+  }
+
+  long lanes[4];
+  _mm256_storeu_si256((__m256i*) lanes, acc);
+  long result = lanes[0];
+
+  for (int j = 1; j < 4; j++) {
+    result = (max ? lanes[j] > result : lanes[j] < result) ? lanes[j] : result;
+  }
+
+  for (; i < length; i++) {
+    result = (max ? x[i] > result : x[i] < result) ? x[i] : result;
+  }
+
+  return result;
+}
+
+LVEC_TARGET
+static void lvec_avx2_scale_flts(double* r, double* x, double k, long length) {
+  __m256d scale = _mm256_set1_pd(k);
+  long i = 0;
+
+  for (; i + 4 <= length; i += 4) {
+    _mm256_storeu_pd(r + i, _mm256_mul_pd(_mm256_loadu_pd(x + i), scale));
+  }
+
+  for (; i < length; i++) {
+    r[i] = x[i] * k;
+  }
+}
+
+LVEC_TARGET
+static double lvec_avx2_sum_flts(double* x, long length) {
+  __m256d acc = _mm256_setzero_pd();
+  long i = 0;
+
+  for (; i + 4 <= length; i += 4) {
+    acc = _mm256_add_pd(acc, _mm256_loadu_pd(x + i));
+  }
+
+  double lanes[4];
+  _mm256_storeu_pd(lanes, acc);
+  double result = (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+
+  for (; i < length; i++) {
+    result += x[i];
+  }
+
+  return result;
+}
+
+/* every lane keeps its own sum, any lane overflowing sends the whole
+ * reduction to the exact path even if the total would fit */
+LVEC_TARGET
+static int lvec_avx2_sum_ints(long* x, long length, long* acc) {
+  __m256i sum = _mm256_setzero_si256();
+  __m256i over = _mm256_setzero_si256();
+  long i = 0;
+
+  for (; i + 4 <= length; i += 4) {
+    __m256i a = _mm256_loadu_si256((__m256i*) (x + i));
+    __m256i r = _mm256_add_epi64(sum, a);
+
+    over = _mm256_or_si256(over, lvec_avx2_overflow(sum, a, r));
+    sum = r;
+  }
+
+  if (_mm256_movemask_pd(_mm256_castsi256_pd(over))) {
+    return 0;
+  }
+
+  long lanes[4];
+  _mm256_storeu_si256((__m256i*) lanes, sum);
+  long result = 0;
+
+  for (int j = 0; j < 4; j++) {
+    if (__builtin_add_overflow(result, lanes[j], &result)) {
+      return 0;
+    }
+  }
+
+  for (; i < length; i++) {
+    if (__builtin_add_overflow(result, x[i], &result)) {
+      return 0;
+    }
+  }
+
+  *acc = result;
+  return 1;
+}
+
+#endif
+
+/* scalar kernels, the fallback for every operation and the only version
+ * of those on integers that need overflow checked multiplication */
+
+static int lvec_add_ints(long* r, long* x, long* y, long length) {
+#ifdef LVEC_AVX2
+  if (lvec_avx2()) {
+    return lvec_avx2_add_ints(r, x, y, length);
+  }
+#endif
+
+  for (long i = 0; i < length; i++) {
+    if (__builtin_add_overflow(x[i], y[i], &r[i])) {
+      return 0;
+    }
+  }
+
+  return 1;
+}
+
+static void lvec_add_flts(double* r, double* x, double* y, long length) {
+#ifdef LVEC_AVX2
+  if (lvec_avx2()) {
+    lvec_avx2_add_flts(r, x, y, length);
+    return;
+  }
+#endif
+
+  for (long i = 0; i < length; i++) {
+    r[i] = x[i] + y[i];
+  }
+}
+
+static double lvec_dot_flts(double* x, double* y, long length) {
+#ifdef LVEC_AVX2
+  if (lvec_avx2()) {
+    return lvec_avx2_dot_flts(x, y, length);
+  }
+#endif
+
+  double acc[4] = { 0, 0, 0, 0 };
+  long i = 0;
+
+  for (; i + 4 <= length; i += 4) {
+    for (int j = 0; j < 4; j++) {
+      acc[j] += x[i + j] * y[i + j];
+    }
+  }
+
+  double result = (acc[0] + acc[1]) + (acc[2] + acc[3]);
+
+  for (; i < length; i++) {
+    result += x[i] * y[i];
+  }
+
+  return result;
+}
+
+static int lvec_dot_ints(long* x, long* y, long length, long* acc) {
+  long result = 0;
+
+  for (long i = 0; i < length; i++) {
+    long product;
+
+    if (__builtin_mul_overflow(x[i], y[i], &product) ||
+        __builtin_add_overflow(result, product, &result)) {
+      return 0;
+    }
+  }
+
+  *acc = result;
+  return 1;
+}
+
+static double lvec_extreme_flts(double* x, long length, int max) {
+#ifdef LVEC_AVX2
+  if (lvec_avx2()) {
+    return lvec_avx2_extreme_flts(x, length, max);
+  }
+#endif
+
+  double result = x[0];
+
+  for (long i = 1; i < length; i++) {
+    result = (max ? x[i] > result : x[i] < result) ? x[i] : result;
+  }
+
+  return result;
+}
+
+static long lvec_extreme_ints(long* x, long length, int max) {
+#ifdef LVEC_AVX2
+  if (lvec_avx2()) {
+    return lvec_avx2_extreme_ints(x, length, max);
+  }
+#endif
+
+  long result = x[0];
+
+  for (long i = 1; i < length; i++) {
+    result = (max ? x[i] > result : x[i] < result) ? x[i] : result;
+  }
+
+  return result;
+}
+
+static void lvec_scale_flts(double* r, double* x, double k, long length) {
+#ifdef LVEC_AVX2
+  if (lvec_avx2()) {
+    lvec_avx2_scale_flts(r, x, k, length);
+    return;
+  }
+#endif
+
+  for (long i = 0; i < length; i++) {
+    r[i] = x[i] * k;
+  }
+}
+
+static int lvec_scale_ints(long* r, long* x, long k, long length) {
+  for (long i = 0; i < length; i++) {
+    if (__builtin_mul_overflow(x[i], k, &r[i])) {
+      return 0;
+    }
+  }
+
+  return 1;
+}
+
+static double lvec_sum_flts(double* x, long length) {
+#ifdef LVEC_AVX2
+  if (lvec_avx2()) {
+    return lvec_avx2_sum_flts(x, length);
+  }
+#endif
+
+  double acc[4] = { 0, 0, 0, 0 };
+  long i = 0;
+
+  for (; i + 4 <= length; i += 4) {
+    for (int j = 0; j < 4; j++) {
+      acc[j] += x[i + j];
+    }
+  }
+
+  double result = (acc[0] + acc[1]) + (acc[2] + acc[3]);
+
+  for (; i < length; i++) {
+    result += x[i];
+  }
+
+  return result;
+}
+
+/* check that every element of a float vector is finite */
+static int lvec_finite(double* x, long length) {
+  for (long i = 0; i < length; i++) {
+    if (!isfinite(x[i])) {
+      return 0;
+    }
+  }
+
+  return 1;
+}
+
+/* the elements as doubles, converted into a new buffer for integers */
+static double* lvec_flts(lvec* lv) {
+  if (lv->kind == LVEC_FLOAT) {
+    return lv->flts;
+  }
+
+  double* flts = malloc(sizeof(double) * (lv->length ? lv->length : 1));
+
+  for (long i = 0; i < lv->length; i++) {
+    flts[i] = lv->ints[i];
+  }
+
+  return flts;
+}
+
+/* double the room for elements */
+static void lvec_grow(lvec* lv) {
+  lv->capacity *= 2;
+
+  if (lv->ints) {
+    lv->ints = realloc(lv->ints, sizeof(long) * lv->capacity);
+  }
+
+  if (lv->flts) {
+    lv->flts = realloc(lv->flts, sizeof(double) * lv->capacity);
+  }
+
+  if (lv->cells) {
+    lv->cells = realloc(lv->cells, sizeof(lval*) * lv->capacity);
+  }
+}
+
+/* narrowest kind of vector that can hold a value */
+static int lvec_kind(lval* x) {
+  switch (x->type) {
+    case LVAL_NUM:
+      return LVEC_INT;
+
+    case LVAL_FLOAT:
+      return LVEC_FLOAT;
+  }
+
+  return LVEC_ANY;
+}
+
+/* move a value that fits the kind of the vector into an empty slot */
+static void lvec_store(lvec* lv, long i, lval* x) {
+  switch (lv->kind) {
+    case LVEC_ANY:
+      lv->cells[i] = x;
+      return;
+
+    case LVEC_FLOAT:
+      lv->flts[i] = x->type == LVAL_FLOAT ? x->flt : x->num;
+      break;
+
+    case LVEC_INT:
+      lv->ints[i] = x->num;
+      break;
+  }
+
+  lval_del(x);
+}
+
+/* convert the elements in place so the vector can also hold x */
+static void lvec_widen(lvec* lv, lval* x) {
+  int kind = lvec_kind(x);
+
+  if (kind >= lv->kind) {
+    return;
+  }
+
+  if (kind == LVEC_FLOAT) {
+    lv->flts = malloc(sizeof(double) * lv->capacity);
+
+    for (long i = 0; i < lv->length; i++) {
+      lv->flts[i] = lv->ints[i];
+    }
+  } else {
+    lv->cells = malloc(sizeof(lval*) * lv->capacity);
+
+    for (long i = 0; i < lv->length; i++) {
+      lv->cells[i] = lvec_get(lv, i);
+    }
+
+    free(lv->flts);
+    lv->flts = NULL;
+  }
+
+  free(lv->ints);
+  lv->ints = NULL;
+  lv->kind = kind;
+}
+
+
+/* x op y for any two numbers through builtin_op, consuming both */
+static lval* lvec_op(int op, lval* x, lval* y) {
+  return builtin_op(NULL, lval_add(lval_add(lval_sexpr(), x), y), op);
+}
+
+/* element-wise x op y, or x op k where y is NULL, on boxed numbers. This
+ * covers big integers, and the result is of the narrowest kind that
+ * holds every element */
+static lval* lvec_boxed_each(int op, lvec* x, lvec* y, lval* k) {
+  lvec* r = lvec_new(LVEC_INT, 0);
+
+  for (long i = 0; i < x->length; i++) {
+    lval* e = lvec_op(op, lvec_get(x, i), y ? lvec_get(y, i) : lval_copy(k));
+
+    if (e->type == LVAL_ERR) {
+      lvec_del(r);
+      return e;
+    }
+
+    lvec_push(r, e);
+  }
+
+  return lval_vec(r);
+}
+
+/* sum of the elements, or dot product with y where it is given, on boxed
+ * numbers. Slow, but only taken for vectors of big integers or when the
+ * result does not fit a long */
+static lval* lvec_boxed_sum(lvec* x, lvec* y) {
+  lval* acc = lval_num(0);
+
+  for (long i = 0; i < x->length; i++) {
+    lval* term = lvec_get(x, i);
+
+    if (y) {
+      term = lvec_op(LOP_MUL, term, lvec_get(y, i));
+    }
+
+    if (term->type == LVAL_ERR) {
+      lval_del(acc);
+      return term;
+    }
+
+    acc = lvec_op(LOP_ADD, acc, term);
+
+    if (acc->type == LVAL_ERR) {
+      return acc;
+    }
+  }
+
+  return acc;
+}
+
+/* smallest element, or largest when max is set, on boxed numbers */
+static lval* lvec_boxed_extreme(lvec* lv, int max) {
+  lval* best = lvec_get(lv, 0);
+
+  for (long i = 1; i < lv->length; i++) {
+    lval* x = lvec_get(lv, i);
+    lval* better = lvec_op(max ? LOP_GT : LOP_LT, lval_copy(x), lval_copy(best));
+
+    if (better->num) {
+      lval_del(best);
+      best = x;
+    } else {
+      lval_del(x);
+    }
+
+    lval_del(better);
+  }
+
+  return best;
+}
+
+
+/* element-wise sum of two vectors of the same length, of big integers
+ * where a sum does not fit a long */
+lval* lvec_add(lvec* x, lvec* y) {
+  if (x->length != y->length) {
+    return lval_err("Vectors of different lengths. Got %li and %li.",
+      x->length, y->length);
+  }
+
+  if (x->kind == LVEC_ANY || y->kind == LVEC_ANY) {
+    return lvec_boxed_each(LOP_ADD, x, y, NULL);
+  }
+
+  if (x->kind == LVEC_INT && y->kind == LVEC_INT) {
+    lvec* r = lvec_new(LVEC_INT, x->length);
+
+    if (!lvec_add_ints(r->ints, x->ints, y->ints, x->length)) {
+      lvec_del(r);
+      return lvec_boxed_each(LOP_ADD, x, y, NULL);
+    }
+
+    return lval_vec(r);
+  }
+
+  /* a vector of floats makes the result floats */
+  double* a = lvec_flts(x);
+  double* b = lvec_flts(y);
+
+  lvec* r = lvec_new(LVEC_FLOAT, x->length);
+  lvec_add_flts(r->flts, a, b, x->length);
+
+  if (a != x->flts) { free(a); }
+  if (b != y->flts) { free(b); }
+
+  if (!lvec_finite(r->flts, r->length)) {
+    lvec_del(r);
+    return lval_err("Float overflow adding vectors.");
+  }
+
+  return lval_vec(r);
+}
+
+lval* lvec_dot(lvec* x, lvec* y) {
+  if (x->length != y->length) {
+    return lval_err("Vectors of different lengths. Got %li and %li.",
+      x->length, y->length);
+  }
+
+  if (x->kind == LVEC_ANY || y->kind == LVEC_ANY) {
+    return lvec_boxed_sum(x, y);
+  }
+
+  if (x->kind == LVEC_INT && y->kind == LVEC_INT) {
+    long acc;
+
+    if (!lvec_dot_ints(x->ints, y->ints, x->length, &acc)) {
+      return lvec_boxed_sum(x, y);
+    }
+
+    return lval_num(acc);
+  }
+
+  double* a = lvec_flts(x);
+  double* b = lvec_flts(y);
+
+  double acc = lvec_dot_flts(a, b, x->length);
+
+  if (a != x->flts) { free(a); }
+  if (b != y->flts) { free(b); }
+
+  if (!isfinite(acc)) {
+    return lval_err("Float overflow!");
+  }
+
+  return lval_float(acc);
+}
+
+void lvec_del(lvec* lv) {
+  if (--lv->refs > 0) {
+    return;
+  }
+
+  if (lv->cells) {
+    for (long i = 0; i < lv->length; i++) {
+      lval_del(lv->cells[i]);
+    }
+  }
+
+  free(lv->ints);
+  free(lv->flts);
+  free(lv->cells);
+  free(lv);
+}
+
+int lvec_eq(lvec* x, lvec* y) {
+  if (x->length != y->length) {
+    return 0;
+  }
+
+  if (x->kind == y->kind && x->kind != LVEC_ANY) {
+    for (long i = 0; i < x->length; i++) {
+      if (x->kind == LVEC_INT ? x->ints[i] != y->ints[i]
+                              : x->flts[i] != y->flts[i]) {
+        return 0;
+      }
+    }
+
+    return 1;
+  }
+
+  /* a vector widened by set can hold the same values as a typed one */
+  for (long i = 0; i < x->length; i++) {
+    lval* a = lvec_get(x, i);
+    lval* b = lvec_get(y, i);
+    int eq = lval_eq(a, b);
+
+    lval_del(a);
+    lval_del(b);
+
+    if (!eq) {
+      return 0;
+    }
+  }
+
+  return 1;
+}
+
+/* smallest element, or largest when max is set, of a non-empty vector */
+lval* lvec_extreme(lvec* lv, int max) {
+  if (lv->kind == LVEC_ANY) {
+    return lvec_boxed_extreme(lv, max);
+  }
+
+  if (lv->kind == LVEC_INT) {
+    return lval_num(lvec_extreme_ints(lv->ints, lv->length, max));
+  }
+
+  return lval_float(lvec_extreme_flts(lv->flts, lv->length, max));
+}
+
+/* element i as a new value */
+lval* lvec_get(lvec* lv, long i) {
+  switch (lv->kind) {
+    case LVEC_ANY:
+      return lval_copy(lv->cells[i]);
+
+    case LVEC_FLOAT:
+      return lval_float(lv->flts[i]);
+  }
+
+  return lval_num(lv->ints[i]);
+}
+
+/* numbers hash the same whatever the kind of vector holding them */
+unsigned long lvec_hash(lvec* lv) {
+  unsigned long hash = lv->length;
+
+  for (long i = 0; i < lv->length; i++) {
+    lval* cell = lv->kind == LVEC_ANY ? lv->cells[i] : NULL;
+    unsigned long word;
+
+    if (lv->kind == LVEC_INT || (cell && cell->type == LVAL_NUM)) {
+      word = cell ? cell->num : lv->ints[i];
+    } else if (lv->kind == LVEC_FLOAT || (cell && cell->type == LVAL_FLOAT)) {
+      /* both zeros are equal so they hash the same */
+      double flt = cell ? cell->flt : lv->flts[i];
+      flt = flt == 0 ? 0 : flt;
+      memcpy(&word, &flt, sizeof(word));
+    } else {
+      word = lval_hash(cell);
+    }
+
+    hash = (hash ^ word) * 1099511628211UL;
+  }
+
+  return hash;
+}
+
+/* vector of length elements, left uninitialized */
+lvec* lvec_new(int kind, long length) {
+  lvec* lv = malloc(sizeof(lvec));
+  lv->refs = 1;
+  lv->kind = kind;
+  lv->length = length;
+  lv->capacity = length > 0 ? length : 1;
+  lv->ints = NULL;
+  lv->flts = NULL;
+  lv->cells = NULL;
+
+  switch (kind) {
+    case LVEC_ANY:
+      lv->cells = malloc(sizeof(lval*) * lv->capacity);
+      break;
+
+    case LVEC_FLOAT:
+      lv->flts = malloc(sizeof(double) * lv->capacity);
+      break;
+
+    case LVEC_INT:
+      lv->ints = malloc(sizeof(long) * lv->capacity);
+      break;
+  }
+
+  return lv;
+}
+
+/* check that every element is a number, as in a typed vector */
+int lvec_numeric(lvec* lv) {
+  if (lv->kind != LVEC_ANY) {
+    return 1;
+  }
+
+  for (long i = 0; i < lv->length; i++) {
+    int type = lv->cells[i]->type;
+
+    if (type != LVAL_NUM && type != LVAL_BIG && type != LVAL_FLOAT) {
+      return 0;
+    }
+  }
+
+  return 1;
+}
+
+/* append an element, taking ownership of it. Amortized constant time as
+ * the buffer doubles when full */
+void lvec_push(lvec* lv, lval* x) {
+  if (lv->length == lv->capacity) {
+    lvec_grow(lv);
+  }
+
+  lvec_widen(lv, x);
+  lvec_store(lv, lv->length++, x);
+}
+
+/* replace element i, taking ownership of the new one */
+void lvec_set(lvec* lv, long i, lval* x) {
+  lvec_widen(lv, x);
+
+  if (lv->kind == LVEC_ANY) {
+    lval_del(lv->cells[i]);
+  }
+
+  lvec_store(lv, i, x);
+}
+
+/* elements from up to but not including to, copied into a new vector */
+lvec* lvec_slice(lvec* lv, long from, long to) {
+  lvec* slice = lvec_new(lv->kind, to - from);
+
+  switch (lv->kind) {
+    case LVEC_ANY:
+      for (long i = from; i < to; i++) {
+        slice->cells[i - from] = lval_copy(lv->cells[i]);
+      }
+      break;
+
+    case LVEC_FLOAT:
+      memcpy(slice->flts, lv->flts + from, sizeof(double) * (to - from));
+      break;
+
+    case LVEC_INT:
+      memcpy(slice->ints, lv->ints + from, sizeof(long) * (to - from));
+      break;
+  }
+
+  return slice;
+}
+
+void lvec_write(lbuf* lb, lvec* lv) {
+  lbuf_char(lb, '[');
+
+  for (long i = 0; i < lv->length; i++) {
+    switch (lv->kind) {
+      case LVEC_ANY:
+        lval_write(lb, lv->cells[i]);
+        break;
+
+      case LVEC_FLOAT:
+        lval_float_write(lb, lv->flts[i]);
+        break;
+
+      case LVEC_INT:
+        lbuf_long(lb, lv->ints[i]);
+        break;
+    }
+
+    if (i != lv->length - 1) {
+      lbuf_char(lb, ' ');
+    }
+  }
+
+  lbuf_char(lb, ']');
+}
+
+/* every element multiplied by a number, big integers where a product
+ * does not fit a long */
+lval* lvec_scale(lvec* lv, lval* k) {
+  if (lv->kind == LVEC_ANY || k->type == LVAL_BIG) {
+    return lvec_boxed_each(LOP_MUL, lv, NULL, k);
+  }
+
+  if (lv->kind == LVEC_INT && k->type == LVAL_NUM) {
+    lvec* r = lvec_new(LVEC_INT, lv->length);
+
+    if (!lvec_scale_ints(r->ints, lv->ints, k->num, lv->length)) {
+      lvec_del(r);
+      return lvec_boxed_each(LOP_MUL, lv, NULL, k);
+    }
+
+    return lval_vec(r);
+  }
+
+  double* x = lvec_flts(lv);
+  double scale = k->type == LVAL_FLOAT ? k->flt : k->num;
+
+  lvec* r = lvec_new(LVEC_FLOAT, lv->length);
+  lvec_scale_flts(r->flts, x, scale, lv->length);
+
+  if (x != lv->flts) { free(x); }
+
+  if (!lvec_finite(r->flts, r->length)) {
+    lvec_del(r);
+    return lval_err("Float overflow scaling vector.");
+  }
+
+  return lval_vec(r);
+}
+
+/* sum of the elements, a big integer if it does not fit a long */
+lval* lvec_sum(lvec* lv) {
+  if (lv->kind == LVEC_ANY) {
+    return lvec_boxed_sum(lv, NULL);
+  }
+
+  if (lv->kind == LVEC_INT) {
+    long acc;
+
+    if (!lvec_sum_ints(lv->ints, lv->length, &acc)) {
+      return lvec_boxed_sum(lv, NULL);
+    }
+
+    return lval_num(acc);
+  }
+
+  double acc = lvec_sum_flts(lv->flts, lv->length);
+
+  if (!isfinite(acc)) {
+    return lval_err("Float overflow!");
+  }
+
+  return lval_float(acc);
+}
+
+/* sum of integers into acc, 0 if it may not fit in a long */
+int lvec_sum_ints(long* x, long length, long* acc) {
+#ifdef LVEC_AVX2
+  if (lvec_avx2()) {
+    return lvec_avx2_sum_ints(x, length, acc);
+  }
+#endif
+
+  long result = 0;
+
+  for (long i = 0; i < length; i++) {
+    if (__builtin_add_overflow(result, x[i], &result)) {
+      return 0;
+    }
+  }
+
+  *acc = result;
+  return 1;
+}
@@ -0,0 +1,50 @@
+#ifndef LVEC_H_
+#define LVEC_H_
+
+#include "lval.h"
+
+
+/* element types of a vector, from the one that holds the most values */
+enum {
+  LVEC_ANY,
+  LVEC_FLOAT,
+  LVEC_INT,
+};
+
+/* elements of a single type in one growable contiguous buffer, shared by
+ * reference between copies so set and push change every copy. Only the
+ * pointer matching kind is set */
+typedef struct lvec {
+  int refs;
+  int kind;
+
+  long length;
+  long capacity;
+  long* ints;
+  double* flts;
+  lval** cells;
+} lvec;
+
+
+int lvec_eq(lvec*, lvec*);
+int lvec_numeric(lvec*);
+int lvec_sum_ints(long*, long, long*);
+
+lval* lvec_add(lvec*, lvec*);
+lval* lvec_dot(lvec*, lvec*);
+lval* lvec_extreme(lvec*, int);
+lval* lvec_get(lvec*, long);
+lval* lvec_scale(lvec*, lval*);
+lval* lvec_sum(lvec*);
+
+lvec* lvec_new(int, long);
+lvec* lvec_slice(lvec*, long, long);
+
+unsigned long lvec_hash(lvec*);
+
+void lvec_del(lvec*);
+void lvec_push(lvec*, lval*);
+void lvec_set(lvec*, long, lval*);
+void lvec_write(struct lbuf*, lvec*);
+
+#endif
@@ -1,9 +1,15 @@
+#include <limits.h>
+#include <math.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include "builtins.h"
+#include "lbig.h"
 #include "lenv.h"
+#include "lprof.h"
 #include "lval.h"
 #include "mpc.h"
 
@@ -34,7 +40,13 @@ void add_history(char* unused) {}
 
 // FIXME!
 lval* lval_eval(lenv*, lval*);
-lval* lval_eval_sexpr(lenv*, lval*);
+lval* lval_exec(lenv*, lval*);
+lval* lval_exec_fold(lenv*, lval*, int, long*);
+lval* lval_exec_list(lenv*, lval*, lval*);
+lval* lval_exec_num(lenv*, lval*, long*);
+lval* lval_exec_op(lenv*, lval*, int);
+lval* lval_exec_sexpr(lenv*, lval*);
+lval* lval_exec_sexpr_num(lenv*, lval*, long*);
 lval* lval_pop(lval*, int);
 lval* lval_read(mpc_ast_t*);
 lval* lval_read_num(mpc_ast_t*);
@@ -54,7 +66,7 @@ int main(int argc, char** argv) {
   /* define them with the following language */
   mpca_lang(MPCA_LANG_DEFAULT,
     "                                                        \
-      number : /-?[0-9]+/ ;                                  \
+      number : /-?[0-9]+(\\.[0-9]+)?([eE][+-]?[0-9]+)?/ ;    \
       symbol : /[a-zA-Z0-9_+\\-*\\/\\\\=<>!&]+/ ;            \
       sexpr  : '(' <expr>* ')' ;                             \
       qexpr  : '{' <expr>* '}' ;                             \
@@ -107,10 +119,105 @@ int main(int argc, char** argv) {
   return 0;
 }
 
+/* value of eight ASCII digits, first digit in the lowest byte of the
+ * word, or -1 if any of the bytes is not a digit. All eight are checked
+ * and converted at once with a few multiplications */
+static long lval_read_eight(char* s) {
+  uint64_t x;
+  memcpy(&x, s, sizeof(x));
+
+  /* digits are 0x30 to 0x39, adding 6 must not carry out of the nibble */
+  if (((x & 0xF0F0F0F0F0F0F0F0) |
+       (((x + 0x0606060606060606) & 0xF0F0F0F0F0F0F0F0) >> 4))
+      != 0x3333333333333333) {
+    return -1;
+  }
+
+  /* combine neighbouring digits into pairs, then pairs into the value */
+  x -= 0x3030303030303030;
+  x = x * 10 + (x >> 8);
+  x = (((x & 0x000000FF000000FF) * (100 + (1000000ULL << 32))) +
+       (((x >> 16) & 0x000000FF000000FF) * (1 + (10000ULL << 32)))) >> 32;
+
+  return (long) x;
+}
+
+/* read a decimal integer from length characters of s into num. Returns 1
+ * when it fits in a long, 0 when it is an integer too large for one and
+ * -1 when it is not an integer at all */
+static int lval_read_long(char* s, int length, long* num) {
+  int negative = length > 0 && s[0] == '-';
+  int i = negative;
+
+  if (i == length) {
+    return -1;
+  }
+
+  unsigned long mag = 0;
+  int over = 0;
+
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+  for (; i + 8 <= length; i += 8) {
+    long eight = lval_read_eight(s + i);
+
+    /* the digit by digit loop finds what is wrong */
+    if (eight < 0) {
+      break;
+    }
+
+    over = over || __builtin_mul_overflow(mag, 100000000UL, &mag) ||
+      __builtin_add_overflow(mag, (unsigned long) eight, &mag);
+  }
+#endif
+
+  for (; i < length; i++) {
+    unsigned digit = (unsigned char) s[i] - '0';
+
+    if (digit > 9) {
+      return -1;
+    }
+
+    over = over || __builtin_mul_overflow(mag, 10UL, &mag) ||
+      __builtin_add_overflow(mag, digit, &mag);
+  }
+
+  unsigned long limit = negative ? (unsigned long) LONG_MAX + 1 : LONG_MAX;
+
+  if (over || mag > limit) {
+    return 0;
+  }
+
+  if (!negative) {
+    *num = mag;
+  } else {
+    *num = mag == limit ? LONG_MIN : -(long) mag;
+  }
+
+  return 1;
+}
+
 lval* lval_read_num(mpc_ast_t* tree) {
-  errno = 0;
-  long num = strtol(tree->contents, NULL, 10);
-  return errno != ERANGE ? lval_num(num) : lval_err("Invalid number");
+  char* s = tree->contents;
+  long num;
+
+  switch (lval_read_long(s, strlen(s), &num)) {
+    case 1:
+      return lval_num(num);
+
+    /* literals too large for a long are read as big integers */
+    case 0:
+      return lval_big(lbig_read(s));
+  }
+
+  /* otherwise it has a point or an exponent and is a float, which must
+   * be finite as no literal reads back as infinity */
+  double flt = strtod(s, NULL);
+
+  if (!isfinite(flt)) {
+    return lval_err("Float literal out of range. Got %s.", s);
+  }
+
+  return lval_float(flt);
 }
 
 lval* lval_read(mpc_ast_t* tree) {
@@ -153,67 +260,286 @@ lval* lval_read(mpc_ast_t* tree) {
   return acc;
 }
 
-lval* lval_eval_sexpr(lenv* le, lval* lv) {
+lval* lval_eval(lenv* le, lval* lv) {
 
-  /* evaluate children */
-  for (int i = 0; i < lv->length; i++) {
-    lv->cell[i] = lval_eval(le, lv->cell[i]);
+  /* all other lval types remain the same */
+  if (lv->type != LVAL_SYM && lv->type != LVAL_SEXPR) {
+    return lv;
+  }
+
+  /* evaluate symbols and S-expressions, then dispose of the input */
+  lval* acc = lval_exec(le, lv);
+  lval_del(lv);
+  return acc;
+}
+
+/* evaluate without consuming the input, only the result is allocated */
+lval* lval_exec(lenv* le, lval* lv) {
+
+  /* evaluate symbols */
+  if (lv->type == LVAL_SYM) {
+    return lenv_get(le, lv);
+  }
+
+  /* evaluate S-expressions */
+  if (lv->type == LVAL_SEXPR) {
+    return lval_exec_sexpr(le, lv);
+  }
+
+  /* all other lval types evaluate to a copy of themselves */
+  return lval_copy(lv);
+}
+
+/* evaluate an arithmetic expression into acc. Returns NULL when the result
+ * is a number, otherwise the error or the value the general path made */
+lval* lval_exec_fold(lenv* le, lval* lv, int op, long* acc) {
+
+  /* the operands never outlive the call, so they are evaluated into a
+   * scratch vector rather than a list of boxed values. It is on the stack
+   * unless there are many of them */
+  long scratch[LOP_SCRATCH];
+  int length = lv->length - 1;
+  long* x = length > LOP_SCRATCH ? malloc(sizeof(long) * length) : scratch;
+
+  lval* value = NULL;
+  int i = 0;
+
+  for (; i < length; i++) {
+    lval* arg = lv->cell[i + 1];
+
+    if (arg->type == LVAL_NUM) {
+      x[i] = arg->num;
+      continue;
+    }
+
+    /* read numbers bound to symbols in place rather than copying them */
+    if (arg->type == LVAL_SYM) {
+      lval* bound = lenv_find(le, arg);
+
+      if (bound && bound->type == LVAL_NUM) {
+        x[i] = bound->num;
+        continue;
+      }
+    }
+
+    /* nested arithmetic is fused with this node, the intermediate result
+     * stays unboxed */
+    if (arg->type == LVAL_SEXPR) {
+      value = lval_exec_sexpr_num(le, arg, &x[i]);
+    } else {
+      value = lval_exec_num(le, arg, &x[i]);
+    }
+
+    if (value) {
+      break;
+    }
+  }
+
+  lval* result = NULL;
+
+  if (!value) {
+    int ok = lop_fold(op, x, length, acc);
+
+    if (!ok) {
+      result = lval_err("Division by zero!");
+    }
+
+    /* an overflowing result is redone by the general path in big integers */
+    if (ok < 0) {
+      lval* args = lval_sexpr();
+
+      for (int j = 0; j < length; j++) {
+        args = lval_add(args, lval_num(x[j]));
+      }
+
+      result = builtin_op(le, args, op);
+    }
+  } else if (value->type == LVAL_ERR) {
+    /* an error is returned before the next argument is evaluated */
+    result = value;
+  } else {
+    /* a non-number escapes into a list for the general path to report */
+    lval* args = lval_sexpr();
+
+    for (int j = 0; j < i; j++) {
+      args = lval_add(args, lval_num(x[j]));
+    }
+
+    args = lval_add(args, value);
+
+    for (int j = i + 1; j < length && args; j++) {
+      value = lval_exec(le, lv->cell[j + 1]);
+
+      if (value->type == LVAL_ERR) {
+        lval_del(args);
+        args = NULL;
+        result = value;
+      } else {
+        args = lval_add(args, value);
+      }
+    }
+
+    if (args) {
+      result = builtin_op(le, args, op);
+    }
+  }
+
+  if (x != scratch) {
+    free(x);
+  }
+
+  /* comparisons the general path made still yield a plain number, which
+   * is handed back unboxed like any other */
+  if (result && result->type == LVAL_NUM) {
+    *acc = result->num;
+    lval_del(result);
+    return NULL;
+  }
+
+  return result;
+}
+
+/* evaluate code into x when it yields a number, otherwise return the
+ * value it yields */
+lval* lval_exec_num(lenv* le, lval* lv, long* x) {
+
+  if (lv->type == LVAL_NUM) {
+    *x = lv->num;
+    return NULL;
+  }
+
+  if (lv->type == LVAL_SEXPR) {
+    return lval_exec_sexpr_num(le, lv, x);
+  }
+
+  lval* value = lval_exec(le, lv);
+
+  if (value->type != LVAL_NUM) {
+    return value;
+  }
+
+  *x = value->num;
+  lval_del(value);
+  return NULL;
+}
+
+lval* lval_exec_op(lenv* le, lval* lv, int op) {
+  long acc;
+  lval* value = lval_exec_fold(le, lv, op, &acc);
+  return value ? value : lval_num(acc);
+}
+
+/* evaluate an S-Expression whose head symbol has already been looked up,
+ * func is that binding or NULL if the head is not a bound symbol */
+lval* lval_exec_list(lenv* le, lval* lv, lval* func) {
+
+  if (func) {
+    /* builtin arithmetic takes a fast path */
+    if (lv->length > 1 && lop_code(func) != -1) {
+      return lval_exec_op(le, lv, lop_code(func));
+    }
+
+    /* special forms read the whole expression, unevaluated */
+    if (builtin_special(func)) {
+      return func->builtin(le, lv);
+    }
+  }
+
+  /* evaluate children into a new list, the expression is left untouched */
+  lval* acc = lval_sexpr();
+
+  /* the list never grows past the expression, so size it once up front */
+  if (lv->length > 0) {
+    acc->cell = malloc(sizeof(lval*) * lv->length);
   }
 
-  /* error checking */
   for (int i = 0; i < lv->length; i++) {
-    if (lv->cell[i]->type == LVAL_ERR) {
-      return lval_take(lv, i);
+    /* the head was already looked up, so it is copied rather than found
+     * a second time */
+    lval* x = i == 0 && func ? lval_copy(func) : lval_exec(le, lv->cell[i]);
+
+    /* stop at the first error, the remaining children are not evaluated */
+    if (x->type == LVAL_ERR) {
+      lval_del(acc);
+      return x;
     }
+
+    acc->cell[acc->length++] = x;
   }
 
   /* empty expression */
-  if (lv->length == 0) {
-    return lv;
+  if (acc->length == 0) {
+    return acc;
   }
 
   /* single expression */
-  if (lv->length == 1) {
-    return lval_take(lv, 0);
+  if (acc->length == 1) {
+    return lval_take(acc, 0);
   }
 
   /* ensure first element is a function after evaluation */
-  lval* func = lval_pop(lv, 0);
+  lval* head = lval_pop(acc, 0);
 
-  if (func->type != LVAL_FUNC) {
+  if (head->type != LVAL_FUNC) {
     lval* err = lval_err(
       "S-Expression starts with incorrect type. "
       "Got %s, Expected %s.",
-      ltype_name(func->type), ltype_name(LVAL_FUNC)
+      ltype_name(head->type), ltype_name(LVAL_FUNC)
     );
 
-    lval_del(lv);
-    lval_del(func);
+    lval_del(acc);
+    lval_del(head);
 
     return err;
   }
 
   /* if so call function to get result */
-  lval* acc = lval_call(le, func, lv);
-  lval_del(func);
-  return acc;
+  lval* result = lval_call(le, head, acc);
+  lval_del(head);
+  return result;
 }
 
-lval* lval_eval(lenv* le, lval* lv) {
-  /* evaluate symbols */
-  if (lv->type == LVAL_SYM) {
-    lval* sym = lenv_get(le, lv);
-    lval_del(lv);
-    return sym;
+/* look up the head symbol of an S-Expression */
+static lval* lval_exec_head(lenv* le, lval* lv) {
+  if (lv->length > 0 && lv->cell[0]->type == LVAL_SYM) {
+    return lenv_find(le, lv->cell[0]);
   }
 
-  /* evaluate S-expressions */
-  if (lv->type == LVAL_SEXPR) {
-    return lval_eval_sexpr(le, lv);
+  return NULL;
+}
+
+/* evaluate the elements of a list as an S-Expression, whatever its type */
+lval* lval_exec_sexpr(lenv* le, lval* lv) {
+
+  if (lprof_on) {
+    lprof_node(le, lv);
   }
 
-  /* all other lval types remain the same */
-  return lv;
+  return lval_exec_list(le, lv, lval_exec_head(le, lv));
+}
+
+/* lval_exec_sexpr into x, arithmetic is folded without boxing the result */
+lval* lval_exec_sexpr_num(lenv* le, lval* lv, long* x) {
+
+  if (lprof_on) {
+    lprof_node(le, lv);
+  }
+
+  lval* func = lval_exec_head(le, lv);
+
+  if (func && lv->length > 1 && lop_code(func) != -1) {
+    return lval_exec_fold(le, lv, lop_code(func), x);
+  }
+
+  lval* value = lval_exec_list(le, lv, func);
+
+  if (value->type != LVAL_NUM) {
+    return value;
+  }
+
+  *x = value->num;
+  lval_del(value);
+  return NULL;
 }
 
 lval* lval_pop(lval* lv, int i) {
@@ -223,11 +549,9 @@ lval* lval_pop(lval* lv, int i) {
   /* shift memory after the item at "i" over the top */
   memmove(&lv->cell[i], &lv->cell[i + 1], sizeof(lval*) * (lv->length - i - 1));
 
-  /* decrease the length of items in the list */
+  /* decrease the length of items in the list, the spare slot is kept
+   * rather than reallocated as the list is usually freed soon after */
   lv->length--;
-
-  /* reallocate the memory used */
-  lv->cell = realloc(lv->cell, sizeof(lval*) * lv->length);
   return x;
 }
 
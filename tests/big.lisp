@@ -0,0 +1,30 @@
+(+ 9223372036854775807 1)
+(- -9223372036854775807 2)
+(* 4294967296 4294967296)
+(- (- 0 9223372036854775807 1))
+(/ (- 0 9223372036854775807 1) -1)
+(def {b} (* 3037000500 3037000500))
+b
+(- b 3037000500 3037000500)
+(- b b)
+(+ b -9223372036854775808)
+(/ b 3037000500)
+(/ (* b b) b)
+(* b 0)
+(+ 1 b 2.5)
+(== b 9223372037000250000)
+(< 9223372036854775807 b)
+(> 1 b)
+(== (+ b 0) b)
+(/ b 0)
+(- 100000000000000000000000000000)
+(* -18446744073709551616 -18446744073709551616)
+(/ 340282366920938463463374607431768211456 -18446744073709551616)
+(def {f} (\ {n} {if (== n 0) {1} {* n (f (- n 1))}}))
+(f 30)
+(/ (f 30) (f 28))
+(def {p} (\ {x n} {if (== n 0) {x} {p (* x x) (- n 1)}}))
+(def {e} (p 3 12))
+(- (/ (* e 10) e) 10)
+e
+(- 0 (* e e 1000000000))
@@ -0,0 +1,19 @@
+(if (== 99999999999999999999 99999999999999999999) {1} {2})
+(if (< 99999999999999999999 1) {1} {2})
+(cond {(> 99999999999999999999 0) 3} {1 4})
+(def {i} 99999999999999999990)
+(while (< i 99999999999999999993) {= {i} (+ i 1)})
+i
+(if (< 1 2.5) {1} {2})
+(if (> 1 2.5) {1} {2})
+(cond {(== 1.0 1) 7})
+(cond {(!= 1.0 1) 7} {(<= 2.5 3) 8})
+(def {j} 0)
+(while (< j 2.5) {= {j} (+ j 1)})
+j
+(def {k} (\ {n} {if (< n 1) {0} {+ 1 (k (- n 1))}}))
+(k 1.5)
+(k 3)
+(== 1 2.5)
+(if (+ 1 2.5) {1} {2})
+(if (< 1 {a}) {1} {2})
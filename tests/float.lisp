@@ -0,0 +1,19 @@
+(def {big} (* 1.5e300 3.0))
+big
+(== big 4.5000000000000005e+300)
+4.5e+300
+1E+5
+2.5e-7
+(def {third} (/ 1.0 3.0))
+third
+(== third 0.3333333333333333)
+(def {tiny} (* 5e-324 1.0))
+tiny
+(== tiny 4.94065645841247e-324)
+(- 0.0)
+(* 1e-300 1e-300)
+(* 1e300 1e300)
+(- 0 1e308 1e308)
+(+ 0.5 (* 100000000000000000000 100000000000000000000 100000000000000000000 100000000000000000000 100000000000000000000 100000000000000000000 100000000000000000000 100000000000000000000 100000000000000000000 100000000000000000000 100000000000000000000 100000000000000000000 100000000000000000000 100000000000000000000 100000000000000000000 100000000000000000000))
+1e999
+-1e999
@@ -0,0 +1,10 @@
+(def {a b} 5 {x y})
+(hmap {a 1})
+(hget (hmap {a 1}) a)
+(hget (hmap {a 1}) 5)
+(hget (hmap {a 1}) {a} 0)
+(hmap {{a} b 3 (+ 1 2)})
+(hget (hmap {{a} b}) {a})
+(hdel (hmap {a 1 6 2}) a)
+(hmap {unbound 1})
+(hmap {1 (/ 1 0)})
@@ -0,0 +1,57 @@
+(def {fib} (\ {n} {if (< n 2) {n} {+ (fib (- n 1)) (fib (- n 2))}}))
+(fib 22)
+(tier-stats fib)
+(def {tak} (\ {x y z} {if (< y x) {tak (tak (- x 1) y z) (tak (- y 1) z x) (tak (- z 1) x y)} {z}}))
+(tak 14 8 2)
+(def {f} (\ {a b c} {+ (* a b) (- c) (/ a 2 1) (- a b c 1) (* (+ a 1) (- b 2) 3)}))
+(def {i s} 0 0)
+(while {< i 200} {= {i s} (+ i 1) (+ s (f i (- 50 i) (* i i)))})
+s
+(f 7 3 11)
+(tier-stats f)
+(def {g} (\ {a b} {if (< a b 10 (+ a b 100)) {1} {if (== a b) {2} {if (!= a b (- b)) {3} {4}}}}))
+(def {i s} 0 0)
+(while {< i 200} {= {i s} (+ i 1) (+ s (g (- i 100) (/ i 3)))})
+s
+(tier-stats g)
+(def {d} (\ {a b} {/ a b}))
+(def {i s} 1 0)
+(while {< i 200} {= {i s} (+ i 1) (+ s (d 1000000 (- i 100)))})
+s
+(d 5 0)
+(tier-stats d)
+(def {i s} 1 0)
+(while {< i 200} {= {i s} (+ i 1) (+ s (d 1000000 i))})
+(d -9223372036854775807 -1)
+(d (- -9223372036854775807 1) -1)
+(tier-stats d)
+(def {m} (\ {a} {* a a a}))
+(def {i s} 1 0)
+(while {< i 200} {= {i s} (+ i 1) (+ s (m i))})
+s
+(m 3000000)
+(m 3)
+(tier-stats m)
+(def {k} (\ {a} {- a}))
+(def {i s} 1 0)
+(while {< i 200} {= {i s} (+ i 1) (+ s (k i))})
+s
+(k (- -9223372036854775807 1))
+(def {big} (\ {a} {+ a 5000000000 (- 7000000000 a)}))
+(def {i s} 1 0)
+(while {< i 200} {= {i s} (+ i 1) (+ s (big i))})
+s
+(tier-stats big)
+(def {cnt} (\ {n acc} {if (<= n 0) {acc} {cnt (- n 1) (+ acc n)}}))
+(cnt 5000 0)
+(cnt 5000 0)
+(tier-stats cnt)
+(def {c3} (\ {a b c} {+ (- a b) (- (* c 2)) (== a b c) (> a b c) (>= a b c) (<= a) (< 1 2 3 a)}))
+(def {i s} 1 0)
+(while {< i 200} {= {i s} (+ i 1) (+ s (c3 i (/ i 2) (/ i 4)))})
+s
+(jit 0)
+(def {fib0} (\ {n} {if (< n 2) {n} {+ (fib0 (- n 1)) (fib0 (- n 2))}}))
+(fib0 22)
+(tier-stats fib0)
+(jit 1)
@@ -0,0 +1,23 @@
+(def {n} 0)
+(def {t} (delay {head (list (+ n 100) (def {n} (+ n 1)))}))
+n
+(force t)
+(force t)
+n
+(force 5)
+(def {mk} (\ {x} {delay {* x 2}}))
+(def {d} (mk 21))
+(def {x} 1000)
+(force d)
+(def {from} (\ {k} {lcons k {from (+ k 1)}}))
+(ltake 5 (from 3))
+(ltake 3 (ltail (ltail (from 10))))
+(ltake 4 (lrange 2 5))
+(ltake 3 (lrange 7))
+(def {e} (delay {/ 1 0}))
+(force e)
+(force e)
+(def {bad} (lcons 1 {undefined-rest}))
+(ltake 1 bad)
+(ltake 2 bad)
+(delay 5)
@@ -0,0 +1,32 @@
+(def {sq} (memo (\ {x} {* x x})))
+(sq 4)
+(sq 4)
+(memo-stats sq)
+(def {total} (memo (\ {l} {eval (join {+} l)})))
+(total {1 2 (+ 3 4)})
+(total (join {1 2} {(+ 3 4)}))
+(total {1 2 (+ 3 5)})
+(total {1 2 (+ 3 4)})
+(memo-stats total)
+(def {id} (memo (\ {x} {x}) 2))
+(id 1)
+(id 2)
+(id 1)
+(id 3)
+(memo-stats id)
+(id 1)
+(id 2)
+(memo-stats id)
+(def {inv} (memo (\ {x} {/ 10 x})))
+(inv 0)
+(inv 0)
+(memo-stats inv)
+(inv 5)
+(inv 5)
+(memo-stats inv)
+(def {none} (memo (\ {x} {+ x 1}) 0))
+(none 1)
+(none 1)
+(memo-stats none)
+(memo-stats +)
+(memo (\ {x} {x}) -1)
@@ -0,0 +1,8 @@
+(def {a b} 5 {x y})
+(pmap {a 1})
+(pget (pmap {a 1}) a)
+(pget (pmap {a 1}) 5)
+(pmap {{a} b 3 (+ 1 2)})
+(pget (pmap {{a} b}) {a})
+(pdel (pmap {a 1 6 2}) a)
+(pmap {unbound 1})
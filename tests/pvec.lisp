@@ -0,0 +1,29 @@
+(def {a} 5)
+(pvec {a (+ 1 2) {x y} 4.5})
+(pvec {})
+(pvec {1 unbound 3})
+(pvec {1 (/ 1 0) 3})
+(def {p} (pvec {1 2 3}))
+(def {q} (pvec {4.5 {x} 6}))
+(join p q)
+(join p (pvec {}) q)
+(join (pvec {}) (pvec {}))
+(join p {4 5})
+(head p)
+(tail p)
+(head (pvec {7}))
+(tail (pvec {7}))
+(head (pvec {}))
+(tail (pvec {}))
+(def {r} (join p q p))
+(len r)
+(nth r 3)
+(nth r 8)
+(nth r 9)
+(slice r 2 5)
+(slice r 0 0)
+(slice r 4 2)
+(slice r 0 10)
+(len (pvec {}))
+(nth (pvec {}) 0)
+p
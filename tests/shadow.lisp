@@ -0,0 +1,13 @@
+(def {sq} (\ {x} {* x x}))
+(def {g} (\ {y} {sq y}))
+(def {h} (\ {sq n} {g n}))
+(def {inc} (\ {a} {+ a 1}))
+(def {i wrong} 0 0)
+(while {< i 70} {= {i wrong} (+ i 1) (+ wrong (!= (h inc 3) 4))})
+wrong
+(h inc 3)
+(g 3)
+(= {i wrong} 0 0)
+(while {< i 70} {= {i wrong} (+ i 1) (+ wrong (!= (g 3) 9))})
+wrong
+(h inc 3)
@@ -0,0 +1,17 @@
+(def {g} (\ {y} {if (< y 0) {0} {+ y y}}))
+(def {h} (\ {+ n} {g n}))
+(def {i wrong} 0 0)
+(while {< i 70} {= {i wrong} (+ i 1) (+ wrong (!= (h * 3) 9))})
+wrong
+(tier-stats g)
+(= {i wrong} 0 0)
+(while {< i 70} {= {i wrong} (+ i 1) (+ wrong (!= (g 3) 6))})
+wrong
+(tier-stats g)
+(h * 3)
+(tier-stats g)
+(def {fib} (\ {n} {if (< n 2) {n} {+ (fib (- n 1)) (fib (- n 2))}}))
+(fib 20)
+(tier-stats fib)
+(fib 20)
+(tier-stats fib)
@@ -0,0 +1,72 @@
+(vmap+ (vec 9223372036854775807 1 -5) (vec 1 1 -9223372036854775807))
+(vscale (vec 4611686018427387904 3) 4)
+(vscale (vec -4611686018427387905 3) 2)
+(vmap+ (vec 1e308 1.0) (vec 1e308 2.0))
+(vscale (vec 1e300 1.0) 1e10)
+(vsum (vec 1e308 1e308))
+(vdot (vec 1e200) (vec 1e200))
+(def {b} (vec 1 100000000000000000000 3))
+b
+(vsum b)
+(vdot b b)
+(vmap+ b (vec 1 (- 0 100000000000000000000) 3))
+(vmap+ b (vec 1.5 0 0))
+(vscale b 2)
+(vscale (vec 1 2) 100000000000000000000)
+(vscale b 0.5)
+(vmax b)
+(vmin b)
+(vmin (vec 100000000000000000000 2.5 7))
+(vsum (vec 1 {x}))
+(vmap+ (vec 9223372036854775807 1) (vec 1 1))
+(vsum (vmap+ (vec 9223372036854775807 1) (vec 1 1)))
+(vmap+ (vec 100000000000000000000) (vec 1e308))
+(vdot (vec 100000000000000000000 1) (vec 1.0 1e308))
+(vmax (vec 100000000000000000000 {x}))
+(def {v} (vec 1 2 3 4 5 6 7 8 9 10))
+v
+(vsum v)
+(vdot v v)
+(vmap+ v (vrange 10))
+(vscale v 3)
+(vscale v 0.5)
+(vec 1 2.5 3)
+(vsum (vec 0.25 0.5))
+(vdot (vec 1 2) (vec 0.5 0.25))
+(vmax v)
+(vmin (vec 3 -2.5 7))
+(vec 1 {a} 3)
+(vmap+ (vec 1 2) (vec 1 2 3))
+(vdot (vec 1) (vec 1 2))
+(def {z} (vrange 0))
+z
+(vsum z)
+(vdot z z)
+(vmap+ z z)
+(vscale z 5)
+(vmax z)
+(vmin z)
+(vrange 3 7)
+(nth v 0)
+(nth v 9)
+(nth v 10)
+(nth v -1)
+(len v)
+(len z)
+(slice v 2 5)
+(slice v 0 0)
+(slice v 5 2)
+(slice v 8 11)
+(def {w} (vec 1 2))
+(push w 3)
+(push w 4.5)
+w
+(set w 0 {x})
+w
+(vsum w)
+(set z 0 1)
+(push z 1)
+(vsum z)
+(vsum (vscale (vrange 1 4) 9223372036854775807))
+(vdot (vec 9223372036854775807 9223372036854775807) (vec 2 2))
+(vsum (vec 9223372036854775807 1 -1))